@@ -0,0 +1,296 @@
+#include "BandStatistics.h"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const quint32 STATS_MAGIC = 0x51535354;/// "QSST"
+static const quint32 STATS_VERSION = 1;
+
+BandStatistics::BandStatistics()
+{
+	min = 0;
+	max = 0;
+	mean = 0;
+	stdDev = 0;
+	approximate = false;
+	histogram.fill(0, StatisticsCache::HISTOGRAM_BINS);
+}
+
+double BandStatistics::binWidth() const
+{
+	return histogram.isEmpty() ? 0 : (max - min) / histogram.size();
+}
+
+/**
+* Streaming accumulator for one band. Integer types of up to 16 bits are
+* counted exactly in a 65536 bin table; other types use a 256 bin histogram
+* whose range doubles (merging pairs of bins) whenever a sample falls outside.
+*/
+class BandAccumulator
+{
+public:
+	BandAccumulator(const GDALDataType& gdalType, const bool& hasNoData, const double& noData)
+		: m_exact(gdalType == GDT_Byte || gdalType == GDT_UInt16 || gdalType == GDT_Int16),
+		m_offset(gdalType == GDT_Int16 ? 32768 : 0),
+		m_hasNoData(hasNoData), m_noData(noData)
+	{
+		m_count = 0;
+		m_sum = 0;
+		m_sumSq = 0;
+		m_min = std::numeric_limits<double>::max();
+		m_max = -std::numeric_limits<double>::max();
+		m_low = 0;
+		m_width = 0;
+		m_bins.assign(m_exact ? 65536 : StatisticsCache::HISTOGRAM_BINS, 0);
+	}
+
+	void add(const double* values, const size_t& n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			const double v = values[i];
+			// infinities would grow the adaptive histogram range for ever
+			if (!std::isfinite(v) || (m_hasNoData && v == m_noData)) { continue; }
+
+			m_count++;
+			m_sum += v;
+			m_sumSq += v * v;
+			if (v < m_min) { m_min = v; }
+			if (v > m_max) { m_max = v; }
+
+			if (m_exact) {
+				m_bins[(int)v + m_offset]++;
+			}
+			else {
+				addAdaptive(v);
+			}
+		}
+	}
+
+	BandStatistics result() const
+	{
+		BandStatistics stats;
+		if (m_count == 0) { return stats; }
+
+		stats.min = m_min;
+		stats.max = m_max;
+		stats.mean = m_sum / m_count;
+		stats.stdDev = std::sqrt(std::max(0.0, m_sumSq / m_count - stats.mean * stats.mean));
+
+		// rebin into HISTOGRAM_BINS bins over [min, max]
+		const int nBins = StatisticsCache::HISTOGRAM_BINS;
+		const double range = m_max - m_min;
+		for (size_t i = 0; i < m_bins.size(); i++) {
+			if (m_bins[i] == 0) { continue; }
+			const double center = m_exact ? (double)i - m_offset : m_low + (i + 0.5) * m_width;
+			int bin = range > 0 ? (int)((center - m_min) / range * nBins) : 0;
+			bin = std::min(std::max(bin, 0), nBins - 1);
+			stats.histogram[bin] += m_bins[i];
+		}
+		return stats;
+	}
+
+private:
+	void addAdaptive(const double& v)
+	{
+		const int nBins = (int)m_bins.size();
+
+		// the first sample opens a small range around itself
+		if (m_width == 0) {
+			m_width = std::max(std::fabs(v), 1.0) * 1e-6;
+			m_low = v - m_width * nBins / 2;
+		}
+
+		// grow the range until the sample is covered
+		while (v < m_low || v >= m_low + m_width * nBins) {
+			std::vector<quint64> merged(nBins, 0);
+			if (v < m_low) {
+				// extend to the left: old bins land in the upper half
+				for (int i = 0; i < nBins; i++) { merged[nBins / 2 + i / 2] += m_bins[i]; }
+				m_low -= m_width * nBins;
+			}
+			else {
+				// extend to the right: old bins land in the lower half
+				for (int i = 0; i < nBins; i++) { merged[i / 2] += m_bins[i]; }
+			}
+			m_width *= 2;
+			m_bins.swap(merged);
+		}
+
+		const int bin = std::min((int)((v - m_low) / m_width), nBins - 1);
+		m_bins[bin]++;
+	}
+
+	const bool m_exact;
+	const int m_offset;
+	const bool m_hasNoData;
+	const double m_noData;
+
+	quint64 m_count;
+	double m_sum;
+	double m_sumSq;
+	double m_min;
+	double m_max;
+	double m_low;
+	double m_width;
+	std::vector<quint64> m_bins;
+};
+
+static std::vector<BandAccumulator> band_accumulators(GDALDataset* dataset)
+{
+	std::vector<BandAccumulator> accumulators;
+	for (int c = 1; c <= dataset->GetRasterCount(); c++) {
+		GDALRasterBand *band = dataset->GetRasterBand(c);
+		int hasNoData = FALSE;
+		const double noData = band->GetNoDataValue(&hasNoData);
+		accumulators.push_back(BandAccumulator(band->GetRasterDataType(), hasNoData != FALSE, noData));
+	}
+	return accumulators;
+}
+
+bool StatisticsCache::compute(GDALDataset* dataset, QList<BandStatistics>& stats, const std::atomic<bool>* cancel)
+{
+	const int nBands = dataset->GetRasterCount();
+	const int width = dataset->GetRasterXSize();
+	const int height = dataset->GetRasterYSize();
+	if (nBands <= 0) { return false; }
+
+	std::vector<BandAccumulator> accumulators = band_accumulators(dataset);
+
+	// one pass over the native block windows, all bands per block
+	int nBlockXSize, nBlockYSize;
+	dataset->GetRasterBand(1)->GetBlockSize(&nBlockXSize, &nBlockYSize);
+	std::vector<double> window((size_t)nBlockXSize * nBlockYSize);
+
+	for (int by = 0; by < height; by += nBlockYSize) {
+		if (cancel != nullptr && *cancel) { return false; }
+		const int nRows = std::min(nBlockYSize, height - by);
+		for (int bx = 0; bx < width; bx += nBlockXSize) {
+			const int nCols = std::min(nBlockXSize, width - bx);
+			for (int c = 0; c < nBands; c++) {
+				CPLErr err = dataset->GetRasterBand(c + 1)->RasterIO(GF_Read, bx, by, nCols, nRows,
+					window.data(), nCols, nRows, GDT_Float64, 0, 0);
+				if (err != CE_None) { return false; }
+				accumulators[c].add(window.data(), (size_t)nCols * nRows);
+			}
+		}
+	}
+
+	stats.clear();
+	for (int c = 0; c < nBands; c++) {
+		stats << accumulators[c].result();
+	}
+	return true;
+}
+
+bool StatisticsCache::approximate(GDALDataset* dataset, QList<BandStatistics>& stats)
+{
+	const int nBands = dataset->GetRasterCount();
+	const int width = dataset->GetRasterXSize();
+	const int height = dataset->GetRasterYSize();
+	if (nBands <= 0) { return false; }
+
+	// a decimated read, which GDAL serves from an overview when there is one
+	const double scale = std::min(1.0, (double)APPROXIMATE_SIZE / std::max(width, height));
+	const int nCols = std::max(1, (int)(width * scale));
+	const int nRows = std::max(1, (int)(height * scale));
+	std::vector<double> window((size_t)nCols * nRows);
+
+	std::vector<BandAccumulator> accumulators = band_accumulators(dataset);
+	for (int c = 0; c < nBands; c++) {
+		CPLErr err = dataset->GetRasterBand(c + 1)->RasterIO(GF_Read, 0, 0, width, height,
+			window.data(), nCols, nRows, GDT_Float64, 0, 0);
+		if (err != CE_None) { return false; }
+		accumulators[c].add(window.data(), window.size());
+	}
+
+	stats.clear();
+	for (int c = 0; c < nBands; c++) {
+		stats << accumulators[c].result();
+		stats.last().approximate = scale < 1.0;
+	}
+	return true;
+}
+
+QStringList StatisticsCache::cachePaths(const QString& fileName)
+{
+	QFileInfo fi(fileName);
+	const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/stats";
+	const QByteArray hash = QCryptographicHash::hash(fi.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+
+	return QStringList()
+		<< fi.absoluteFilePath() + ".qssa.stats"
+		<< cacheDir + "/" + QString::fromLatin1(hash) + ".stats";
+}
+
+bool StatisticsCache::load(const QString& fileName, const int& nBands, QList<BandStatistics>& stats)
+{
+	// GDAL virtual paths (/vsimem, /vsicurl, ...) have no size or time to
+	// key the entry on
+	QFileInfo fi(fileName);
+	if (!fi.exists()) { return false; }
+
+	foreach(const QString& path, cachePaths(fileName)) {
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) { continue; }
+
+		QDataStream in(&file);
+		quint32 magic, version;
+		QString key;
+		qint64 size, modified;
+		qint32 count;
+		in >> magic >> version >> key >> size >> modified >> count;
+
+		// the entry has to describe this very file
+		if (magic != STATS_MAGIC || version != STATS_VERSION ||
+			key != fi.absoluteFilePath() || size != fi.size() ||
+			modified != fi.lastModified().toMSecsSinceEpoch() || count != nBands) {
+			continue;
+		}
+
+		// a truncated or foreign histogram is a cache miss
+		QList<BandStatistics> entries;
+		bool valid = true;
+		for (int c = 0; c < count && valid; c++) {
+			BandStatistics band;
+			in >> band.min >> band.max >> band.mean >> band.stdDev >> band.histogram;
+			valid = band.histogram.size() == HISTOGRAM_BINS;
+			entries << band;
+		}
+
+		if (valid && in.status() == QDataStream::Ok) {
+			stats = entries;
+			return true;
+		}
+	}
+	return false;
+}
+
+void StatisticsCache::remove(const QString& fileName)
+{
+	foreach(const QString& path, cachePaths(fileName)) {
+		QFile::remove(path);
+	}
+}
+
+bool StatisticsCache::save(const QString& fileName, const QList<BandStatistics>& stats)
+{
+	QFileInfo fi(fileName);
+	if (!fi.exists()) { return false; }
+
+	foreach(const QString& path, cachePaths(fileName)) {
+		QDir().mkpath(QFileInfo(path).absolutePath());
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) { continue; }
+
+		QDataStream out(&file);
+		out << STATS_MAGIC << STATS_VERSION << fi.absoluteFilePath()
+			<< (qint64)fi.size() << (qint64)fi.lastModified().toMSecsSinceEpoch() << (qint32)stats.size();
+		foreach(const BandStatistics& band, stats) {
+			out << band.min << band.max << band.mean << band.stdDev << band.histogram;
+		}
+		return out.status() == QDataStream::Ok;
+	}
+	return false;
+}
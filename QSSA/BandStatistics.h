@@ -0,0 +1,53 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// GDAL Headers
+#include <gdal_priv.h>
+
+// C++ Standard Libraries
+#include <atomic>
+#include <vector>
+
+/**
+* Per band statistics gathered in one streaming pass over the raster:
+* min/max, mean/stddev and a 256 bin histogram spanning [min, max].
+*/
+struct BandStatistics
+{
+	double min;
+	double max;
+	double mean;
+	double stdDev;
+	QVector<quint64> histogram;
+	bool approximate;/// Estimated from an overview, not persisted
+
+	BandStatistics();
+	double binWidth() const;
+};
+
+/**
+* Computes band statistics and persists them to a sidecar file next to the
+* raster (or to the user cache folder when that is not writable). Entries
+* are keyed by the raster path, size and modification time, so they are
+* recomputed as soon as the file changes; rasters that are not files on
+* disk are never cached. approximate() estimates them
+* from at most APPROXIMATE_SIZE pixels per side, read from an overview when
+* the raster has one.
+*/
+class StatisticsCache
+{
+public:
+	static const int HISTOGRAM_BINS = 256;
+	static const int APPROXIMATE_SIZE = 1024;
+
+	static bool load(const QString& fileName, const int& nBands, QList<BandStatistics>& stats);
+	static bool save(const QString& fileName, const QList<BandStatistics>& stats);
+	static void remove(const QString& fileName);
+	static bool compute(GDALDataset* dataset, QList<BandStatistics>& stats, const std::atomic<bool>* cancel = nullptr);
+	static bool approximate(GDALDataset* dataset, QList<BandStatistics>& stats);
+
+private:
+	static QStringList cachePaths(const QString& fileName);
+};
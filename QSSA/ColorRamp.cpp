@@ -0,0 +1,139 @@
+#include "ColorRamp.h"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+
+ColorRamp::ColorRamp()
+{
+	m_origin = 0;
+	m_scale = 1;
+}
+
+void ColorRamp::setStops(const std::vector<Stop>& stops)
+{
+	m_stops = stops;
+	m_table.clear();
+}
+
+const std::vector<ColorRamp::Stop>& ColorRamp::stops() const
+{
+	return m_stops;
+}
+
+/**
+* Compile the ramp into a lookup table. An integral ramp covers every
+* signed 16-bit elevation one entry each; otherwise the table spans the
+* stops at FINE_STEPS_PER_UNIT entries per elevation unit.
+*/
+bool ColorRamp::build(const bool& integral)
+{
+	m_table.clear();
+	if (m_stops.empty()) {
+		return false;
+	}
+
+	const double lo = m_stops.front().second;
+	const double hi = m_stops.back().second;
+
+	// the integer table is only exact if the clamped ends are constant
+	if (integral && lo >= -32768 && hi <= 32767) {
+		m_origin = -32768;
+		m_scale = 1;
+		m_table.resize(INTEGER_TABLE_SIZE);
+	}
+	else {
+		m_origin = lo;
+		m_scale = FINE_STEPS_PER_UNIT;
+		const double entries = std::ceil((hi - lo) * m_scale) + 1;
+		if (entries > (1 << 24)) {
+			return false;
+		}
+		m_table.resize((size_t)entries);
+	}
+
+	for (size_t i = 0; i < m_table.size(); i++) {
+		m_table[i] = color(m_origin + i / m_scale);
+	}
+	return true;
+}
+
+bool ColorRamp::isBuilt() const
+{
+	return !m_table.empty();
+}
+
+/*
+* Interpolate Colors
+*/
+static cv::Vec3b lerp(cv::Vec3b const& minColor, cv::Vec3b const& maxColor, double const& t)
+{
+	cv::Vec3b output;
+	for (int i = 0; i<3; i++)
+	{
+		output[i] = (uchar)(((1 - t)*minColor[i]) + (t * maxColor[i]));
+	}
+	return output;
+}
+
+/*
+* Evaluate the ramp at one elevation, without the table
+*/
+cv::Vec3b ColorRamp::color(const double& elevation) const
+{
+	// if the elevation is below the minimum, return the minimum
+	if (elevation < m_stops[0].second) {
+		return m_stops[0].first;
+	}
+	// if the elevation is above the maximum, return the maximum
+	if (elevation > m_stops.back().second) {
+		return m_stops.back().first;
+	}
+
+	// otherwise, find the proper starting index
+	int idx = 0;
+	double t = 0;
+	for (int x = 0; x<(int)(m_stops.size() - 1); x++) {
+
+		// if the current elevation is below the next item, then use the current
+		// two colors as our range
+		if (elevation < m_stops[x + 1].second) {
+			idx = x;
+			t = (m_stops[x + 1].second - elevation) /
+				(m_stops[x + 1].second - m_stops[x].second);
+
+			break;
+		}
+	}
+
+	// interpolate the color
+	return lerp(m_stops[idx].first, m_stops[idx + 1].first, t);
+}
+
+/*
+* Gather the colors of a run of elevations from the table
+*/
+void ColorRamp::apply(const float *elevation, cv::Vec3b *bgr, const int& count) const
+{
+	CV_Assert(isBuilt());
+
+	const cv::Vec3b *table = &m_table[0];
+	const float last = (float)(m_table.size() - 1);
+	const float origin = (float)m_origin;
+	const float scale = (float)m_scale;
+	for (int x = 0; x < count; x++) {
+		// clamp before rounding; NaN compares false and lands on the first entry
+		const float index = std::min(last, std::max(0.0f, (elevation[x] - origin) * scale));
+		bgr[x] = table[cvRound(index)];
+	}
+}
+
+void ColorRamp::apply(const cv::Mat& elevation, cv::Mat& bgr) const
+{
+	CV_Assert(elevation.type() == CV_32FC1);
+
+	bgr.create(elevation.size(), CV_8UC3);
+	for (int y = 0; y < elevation.rows; y++) {
+		apply(elevation.ptr<float>(y), bgr.ptr<cv::Vec3b>(y), elevation.cols);
+	}
+}
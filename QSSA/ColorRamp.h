@@ -0,0 +1,41 @@
+#pragma once
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// C++ Standard Libraries
+#include <utility>
+#include <vector>
+
+/**
+* Elevation to BGR color ramp compiled into a lookup table. Integer DEMs
+* get one entry per 16-bit value, so the table reproduces color() exactly;
+* float DEMs get a fine fixed-step table spanning the ramp stops. Outside
+* the stops the ramp is constant, so indices are simply clamped.
+*/
+class ColorRamp
+{
+public:
+	typedef std::pair<cv::Vec3b, double> Stop;
+
+	static const int INTEGER_TABLE_SIZE = 65536;
+	static const int FINE_STEPS_PER_UNIT = 256;
+
+	ColorRamp();
+
+	void setStops(const std::vector<Stop>& stops);
+	const std::vector<Stop>& stops() const;
+
+	bool build(const bool& integral);
+	bool isBuilt() const;
+
+	cv::Vec3b color(const double& elevation) const;
+	void apply(const float *elevation, cv::Vec3b *bgr, const int& count) const;
+	void apply(const cv::Mat& elevation, cv::Mat& bgr) const;
+
+private:
+	std::vector<Stop> m_stops;/// Pushed from low to high elevation
+	std::vector<cv::Vec3b> m_table;
+	double m_origin;/// Elevation of the first table entry
+	double m_scale;/// Table entries per elevation unit
+};
@@ -0,0 +1,318 @@
+#include "FeatureRegistration.h"
+
+// OpenCV Headers
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// User Headers
+#include "Profiler.h"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+FeatureRegistration::FeatureRegistration()
+{
+	m_detector = ORB_DETECTOR;
+	m_coarseSize = 1024;
+	m_fineSize = 4096;
+	m_homography = cv::Matx33d::eye();
+	m_affine = false;
+	m_inliers = 0;
+	m_rmsError = 0;
+}
+
+void FeatureRegistration::setDetector(const Detector& detector)
+{
+	m_detector = detector;
+}
+
+void FeatureRegistration::setLevels(const int& coarseSize, const int& fineSize)
+{
+	m_coarseSize = std::max(coarseSize, 64);
+	m_fineSize = std::max(fineSize, m_coarseSize);
+}
+
+const cv::Matx33d& FeatureRegistration::homography() const
+{
+	return m_homography;
+}
+
+bool FeatureRegistration::isAffine() const
+{
+	return m_affine;
+}
+
+int FeatureRegistration::inliers() const
+{
+	return m_inliers;
+}
+
+double FeatureRegistration::rmsError() const
+{
+	return m_rmsError;
+}
+
+/*
+* SIFT is in the main module since OpenCV 4.4, when its patent had expired;
+* older builds fall back to ORB
+*/
+static cv::Ptr<cv::Feature2D> create_detector(const FeatureRegistration::Detector& detector, const int& features)
+{
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 4)
+	if (detector == FeatureRegistration::SIFT_DETECTOR) {
+		return cv::SIFT::create(features);
+	}
+#endif
+	return cv::ORB::create(features, 1.2f, 8, 31, 0, 2, cv::ORB::HARRIS_SCORE, 31, 10);
+}
+
+/*
+* Hillshade of an elevation grid, sun from the north west at 45 degrees.
+* Without georeferencing the vertical exaggeration is unknown, so slopes
+* are normalised by the mean gradient instead.
+*/
+static cv::Mat hillshade(const cv::Mat& elevation)
+{
+	cv::Mat gx;
+	cv::Mat gy;
+	cv::Sobel(elevation, gx, CV_32F, 1, 0, 3, 1.0 / 8);
+	cv::Sobel(elevation, gy, CV_32F, 0, 1, 3, 1.0 / 8);
+
+	const double mean = cv::mean(cv::abs(gx) + cv::abs(gy))[0];
+	const float scale = mean > 0 ? (float)(0.5 / mean) : 1.0f;
+	const float zenith = (float)(CV_PI / 4);
+	const float azimuth = (float)(CV_PI * 3 / 4);
+
+	cv::Mat shade(elevation.size(), CV_8UC1);
+	for (int y = 0; y < elevation.rows; y++) {
+		const float *dx = gx.ptr<float>(y);
+		const float *dy = gy.ptr<float>(y);
+		uchar *out = shade.ptr<uchar>(y);
+		for (int x = 0; x < elevation.cols; x++) {
+			const float sx = dx[x] * scale;
+			const float sy = dy[x] * scale;
+			const float slope = std::atan(std::sqrt(sx * sx + sy * sy));
+			const float aspect = std::atan2(sy, -sx);
+			const float value = std::cos(zenith) * std::cos(slope) +
+				std::sin(zenith) * std::sin(slope) * std::cos(azimuth - aspect);
+			out[x] = cv::saturate_cast<uchar>(255 * std::max(0.0f, value));
+		}
+	}
+	return shade;
+}
+
+/*
+* One pyramid level of a layer: its overview with the longest side at most
+* size, as Landsat brightness or DEM hillshade with local contrast
+* equalised, and its keypoints
+*/
+bool FeatureRegistration::prepareLevel(MapLayer *layer, const bool& dem, const int& size, const int& features, Level& level) const
+{
+	const double ratio = std::min(1.0, (double)size / std::max(layer->m_width, layer->m_height));
+	const cv::Size levelSize(std::max(1, cvRound(layer->m_width * ratio)), std::max(1, cvRound(layer->m_height * ratio)));
+	cv::Mat image = layer->overview(levelSize);
+	if (image.empty()) {
+		return false;
+	}
+
+	cv::Mat gray;
+	if (dem) {
+		// keep no data sentinels from dominating the gradients
+		cv::Mat elevation;
+		image.reshape(1).convertTo(elevation, CV_32F);
+		cv::max(elevation, -500, elevation);
+		gray = hillshade(elevation);
+	}
+	else {
+		if (image.channels() >= 3) {
+			cv::cvtColor(image, gray, image.channels() == 4 ? cv::COLOR_RGBA2GRAY : cv::COLOR_RGB2GRAY);
+		}
+		else {
+			gray = image;
+		}
+		if (gray.depth() != CV_8U) {
+			cv::normalize(gray, gray, 0, 255, cv::NORM_MINMAX, CV_8U);
+		}
+	}
+	cv::createCLAHE(2.0, cv::Size(8, 8))->apply(gray, level.image);
+
+	level.scale = cv::Matx33d(
+		(double)levelSize.width / layer->m_width, 0, 0,
+		0, (double)levelSize.height / layer->m_height, 0,
+		0, 0, 1);
+
+	cv::Ptr<cv::Feature2D> detector = create_detector(m_detector, features);
+	detector->detectAndCompute(level.image, cv::noArray(), level.keypoints, level.descriptors);
+	return level.keypoints.size() >= 4;
+}
+
+/*
+* Fit the level correspondences with RANSAC and keep the model in full
+* resolution pixels. Homographies that fold or blow up the scene are
+* replaced by an affine fit.
+*/
+bool FeatureRegistration::fit(const Level& landsat, const Level& dem, const std::vector<cv::DMatch>& matches, const double& threshold)
+{
+	if (matches.size() < 4) {
+		return false;
+	}
+
+	std::vector<cv::Point2f> src;
+	std::vector<cv::Point2f> dst;
+	for (size_t i = 0; i < matches.size(); i++) {
+		src.push_back(landsat.keypoints[matches[i].queryIdx].pt);
+		dst.push_back(dem.keypoints[matches[i].trainIdx].pt);
+	}
+
+	std::vector<uchar> mask;
+	cv::Mat model = cv::findHomography(src, dst, cv::RANSAC, threshold, mask, 4000, 0.999);
+	bool affine = false;
+	if (!model.empty()) {
+		const double det = model.at<double>(0, 0) * model.at<double>(1, 1) - model.at<double>(0, 1) * model.at<double>(1, 0);
+		const double perspective = std::abs(model.at<double>(2, 0)) + std::abs(model.at<double>(2, 1));
+		if (det <= 1e-3 || det >= 1e3 || perspective > 1e-2) {
+			model.release();
+		}
+	}
+	if (model.empty()) {
+		cv::Mat partial = cv::estimateAffine2D(src, dst, mask, cv::RANSAC, threshold, 4000, 0.999);
+		if (partial.empty()) {
+			return false;
+		}
+		model = cv::Mat::eye(3, 3, CV_64F);
+		partial.copyTo(model.rowRange(0, 2));
+		affine = true;
+	}
+
+	// residuals of the inliers, in level pixels
+	const cv::Matx33d H = model;
+	int inliers = 0;
+	double squared = 0;
+	for (size_t i = 0; i < mask.size(); i++) {
+		if (!mask[i]) { continue; }
+		const cv::Vec3d p = H * cv::Vec3d(src[i].x, src[i].y, 1);
+		const double dx = p[0] / p[2] - dst[i].x;
+		const double dy = p[1] / p[2] - dst[i].y;
+		squared += dx * dx + dy * dy;
+		inliers++;
+	}
+	if (inliers < 10) {
+		return false;
+	}
+
+	m_homography = dem.scale.inv() * H * landsat.scale;
+	m_affine = affine;
+	m_inliers = inliers;
+	m_rmsError = std::sqrt(squared / inliers) / dem.scale(0, 0);
+	return true;
+}
+
+/*
+* Match every Landsat keypoint against the DEM keypoints inside a window
+* around its predicted position, bucketing the DEM keypoints by window
+*/
+static void guided_match(const std::vector<cv::KeyPoint>& query, const cv::Mat& queryDescriptors,
+	const std::vector<cv::KeyPoint>& train, const cv::Mat& trainDescriptors,
+	const cv::Matx33d& predict, const float& radius, std::vector<cv::DMatch>& matches)
+{
+	const int normType = queryDescriptors.depth() == CV_8U ? cv::NORM_HAMMING : cv::NORM_L2;
+
+	QHash<QPair<int, int>, QVector<int> > buckets;
+	for (int j = 0; j < (int)train.size(); j++) {
+		buckets[qMakePair(cvFloor(train[j].pt.x / radius), cvFloor(train[j].pt.y / radius))].append(j);
+	}
+
+	matches.clear();
+	for (int i = 0; i < (int)query.size(); i++) {
+		const cv::Vec3d p = predict * cv::Vec3d(query[i].pt.x, query[i].pt.y, 1);
+		if (p[2] == 0) { continue; }
+		const cv::Point2f q((float)(p[0] / p[2]), (float)(p[1] / p[2]));
+		const int bx = cvFloor(q.x / radius);
+		const int by = cvFloor(q.y / radius);
+
+		// best and second best candidate inside the window
+		double best = DBL_MAX;
+		double second = DBL_MAX;
+		int bestIndex = -1;
+		for (int cy = by - 1; cy <= by + 1; cy++) {
+			for (int cx = bx - 1; cx <= bx + 1; cx++) {
+				const QVector<int> candidates = buckets.value(qMakePair(cx, cy));
+				for (int k = 0; k < candidates.size(); k++) {
+					const int j = candidates[k];
+					if (std::abs(train[j].pt.x - q.x) > radius || std::abs(train[j].pt.y - q.y) > radius) { continue; }
+					const double distance = cv::norm(queryDescriptors.row(i), trainDescriptors.row(j), normType);
+					if (distance < best) {
+						second = best;
+						best = distance;
+						bestIndex = j;
+					}
+					else if (distance < second) {
+						second = distance;
+					}
+				}
+			}
+		}
+
+		// a lone candidate inside the window is accepted as it is
+		if (bestIndex >= 0 && (second == DBL_MAX || best < 0.9 * second)) {
+			matches.push_back(cv::DMatch(i, bestIndex, (float)best));
+		}
+	}
+}
+
+bool FeatureRegistration::estimate(MapLayer *landsat, MapLayer *dem)
+{
+	ScopedTimer timer("FeatureRegistration::estimate", "registration");
+	m_lastError.clear();
+	const int features = m_detector == SIFT_DETECTOR ? 4000 : 8000;
+
+	// coarse level: match everything, keep the distinctive matches
+	Level landsatLevel;
+	Level demLevel;
+	if (!prepareLevel(landsat, false, m_coarseSize, features, landsatLevel) ||
+		!prepareLevel(dem, true, m_coarseSize, features, demLevel)) {
+		m_lastError = QObject::tr("Too few features were found on the coarse pyramid level.");
+		return false;
+	}
+
+	cv::BFMatcher matcher(landsatLevel.descriptors.depth() == CV_8U ? cv::NORM_HAMMING : cv::NORM_L2);
+	std::vector<std::vector<cv::DMatch> > knn;
+	matcher.knnMatch(landsatLevel.descriptors, demLevel.descriptors, knn, 2);
+	std::vector<cv::DMatch> matches;
+	for (size_t i = 0; i < knn.size(); i++) {
+		if (knn[i].size() == 2 && knn[i][0].distance < 0.8f * knn[i][1].distance) {
+			matches.push_back(knn[i][0]);
+		}
+	}
+	if (!fit(landsatLevel, demLevel, matches, 3.0)) {
+		m_lastError = QObject::tr("The Landsat scene and the DEM hillshade could not be matched.");
+		return false;
+	}
+
+	// finer levels, up to the native resolution: guided matching around the
+	// positions the current estimate predicts
+	const int native = std::max(std::max(landsat->m_width, landsat->m_height),
+		std::max(dem->m_width, dem->m_height));
+	int previous = m_coarseSize;
+	while (previous < m_fineSize && previous < native) {
+		const int levelSize = std::min(previous * 2, m_fineSize);
+		previous = levelSize;
+
+		Level landsatFine;
+		Level demFine;
+		if (!prepareLevel(landsat, false, levelSize, features, landsatFine) ||
+			!prepareLevel(dem, true, levelSize, features, demFine)) {
+			break;
+		}
+
+		const cv::Matx33d predict = demFine.scale * m_homography * landsatFine.scale.inv();
+		guided_match(landsatFine.keypoints, landsatFine.descriptors,
+			demFine.keypoints, demFine.descriptors, predict, 12.0f, matches);
+
+		// keep the coarser estimate when the level does not support a new one
+		fit(landsatFine, demFine, matches, 2.0);
+	}
+	return true;
+}
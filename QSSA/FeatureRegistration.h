@@ -0,0 +1,67 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+// C++ Standard Libraries
+#include <vector>
+
+// User Headers
+#include "MapLayer.h"
+
+/**
+* Registers a Landsat scene onto a DEM from image content alone, for layers
+* without usable georeferencing. Landsat brightness is matched against a
+* hillshade of the DEM: keypoints are detected and matched on a coarse
+* pyramid level and a RANSAC homography (an affine transform when the
+* homography is degenerate) is fitted; finer levels then only match
+* keypoints near where the current estimate predicts them and refit.
+* Detection never runs on the full resolution rasters.
+*/
+class FeatureRegistration
+{
+public:
+	enum Detector
+	{
+		ORB_DETECTOR = 0,
+		SIFT_DETECTOR = 1
+	};
+
+	FeatureRegistration();
+
+	void setDetector(const Detector& detector);
+	void setLevels(const int& coarseSize, const int& fineSize);
+
+	bool estimate(MapLayer *landsat, MapLayer *dem);
+
+	const cv::Matx33d& homography() const;
+	bool isAffine() const;
+	int inliers() const;
+	double rmsError() const;
+
+	QString m_lastError;/// Reason the last estimate failed
+
+private:
+	struct Level
+	{
+		cv::Mat image;
+		cv::Matx33d scale;/// Full resolution pixels to level pixels
+		std::vector<cv::KeyPoint> keypoints;
+		cv::Mat descriptors;
+	};
+
+	bool prepareLevel(MapLayer *layer, const bool& dem, const int& size, const int& features, Level& level) const;
+	bool fit(const Level& landsat, const Level& dem, const std::vector<cv::DMatch>& matches, const double& threshold);
+
+	Detector m_detector;
+	int m_coarseSize;/// Longest side of the first pyramid level
+	int m_fineSize;/// Longest side of the last one
+	cv::Matx33d m_homography;/// Landsat pixel to DEM pixel, full resolution
+	bool m_affine;
+	int m_inliers;
+	double m_rmsError;/// DEM pixels at the finest level, scaled to full resolution
+};
@@ -0,0 +1,172 @@
+#include "FloodFill.h"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+FloodFill::FloodFill()
+{
+	m_connectivity = EIGHT_CONNECTED;
+}
+
+void FloodFill::setElevation(const cv::Mat& elevation, const cv::Mat& outOfBounds)
+{
+	CV_Assert(elevation.type() == CV_32FC1);
+	CV_Assert(outOfBounds.empty() || (outOfBounds.type() == CV_8UC1 && outOfBounds.size() == elevation.size()));
+
+	m_elevation = elevation;
+	m_outOfBounds = outOfBounds.empty() ? cv::Mat::zeros(elevation.size(), CV_8UC1) : outOfBounds;
+	m_visited.assign(((size_t)elevation.rows * elevation.cols + 63) / 64, 0);
+	m_seeds.clear();
+}
+
+void FloodFill::setConnectivity(const Connectivity& connectivity)
+{
+	m_connectivity = connectivity;
+}
+
+/**
+* Seed from the edges of the DEM footprint: in-bounds cells on the grid
+* border or next to an out-of-bounds cell, at or below sea level.
+*/
+size_t FloodFill::seedEdges(const double& seaLevel)
+{
+	const size_t before = m_seeds.size();
+	const int rows = m_elevation.rows;
+	const int cols = m_elevation.cols;
+	for (int y = 0; y < rows; y++) {
+		const float *elevation = m_elevation.ptr<float>(y);
+		const uchar *oob = m_outOfBounds.ptr<uchar>(y);
+		const uchar *above = y > 0 ? m_outOfBounds.ptr<uchar>(y - 1) : nullptr;
+		const uchar *below = y < rows - 1 ? m_outOfBounds.ptr<uchar>(y + 1) : nullptr;
+		for (int x = 0; x < cols; x++) {
+			if (oob[x] || !(elevation[x] <= seaLevel)) {
+				continue;
+			}
+			const bool edge = !above || !below || x == 0 || x == cols - 1 ||
+				above[x] || below[x] || oob[x - 1] || oob[x + 1];
+			if (edge) {
+				m_seeds.push_back(cv::Point(x, y));
+			}
+		}
+	}
+	return m_seeds.size() - before;
+}
+
+/**
+* Seed from a water mask on the same grid, one seed per horizontal run of
+* water cells; the fill reaches the rest of each run anyway.
+*/
+size_t FloodFill::seedMask(const cv::Mat& waterMask)
+{
+	CV_Assert(waterMask.type() == CV_8UC1 && waterMask.size() == m_elevation.size());
+
+	const size_t before = m_seeds.size();
+	for (int y = 0; y < waterMask.rows; y++) {
+		const uchar *water = waterMask.ptr<uchar>(y);
+		const uchar *oob = m_outOfBounds.ptr<uchar>(y);
+		bool inRun = false;
+		for (int x = 0; x < waterMask.cols; x++) {
+			const bool seed = water[x] && !oob[x];
+			if (seed && !inRun) {
+				m_seeds.push_back(cv::Point(x, y));
+			}
+			inRun = seed;
+		}
+	}
+	return m_seeds.size() - before;
+}
+
+inline void FloodFill::mark(const size_t& index)
+{
+	m_visited[index >> 6] |= uint64_t(1) << (index & 63);
+}
+
+/**
+* Priority-flood (Barnes et al.) over the whole grid. Cells are taken from
+* a min-heap ordered by onset; a neighbour's onset is the larger of its own
+* elevation and the onset it is reached from. Neighbours not above the
+* current onset lie in a depression and share that onset, so they go
+* through a plain FIFO instead of the heap. Cells that cannot be reached,
+* are outside the DEM or have no elevation get +inf.
+*/
+void FloodFill::onset(cv::Mat& onset)
+{
+	typedef std::pair<float, size_t> Cell;
+
+	std::fill(m_visited.begin(), m_visited.end(), 0);
+
+	const int rows = m_elevation.rows;
+	const int cols = m_elevation.cols;
+	onset.create(m_elevation.size(), CV_32FC1);
+	onset.setTo(std::numeric_limits<float>::infinity());
+	float *dst = onset.ptr<float>(0);
+	CV_Assert(onset.isContinuous());
+
+	// neighbour offsets, the 4 connected ones first
+	static const int DX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int DY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+	const int neighbours = m_connectivity == EIGHT_CONNECTED ? 8 : 4;
+
+	std::priority_queue<Cell, std::vector<Cell>, std::greater<Cell> > heap;
+	std::deque<size_t> pit;
+
+	for (size_t i = 0; i < m_seeds.size(); i++) {
+		const cv::Point& seed = m_seeds[i];
+		const float elevation = m_elevation.at<float>(seed.y, seed.x);
+		const size_t index = (size_t)seed.y * cols + seed.x;
+		if (m_outOfBounds.at<uchar>(seed.y, seed.x) || std::isnan(elevation) ||
+			(m_visited[index >> 6] & (uint64_t(1) << (index & 63)))) {
+			continue;
+		}
+		mark(index);
+		dst[index] = elevation;
+		heap.push(Cell(elevation, index));
+	}
+
+	while (!heap.empty() || !pit.empty()) {
+		size_t index;
+		if (!pit.empty()) {
+			index = pit.front();
+			pit.pop_front();
+		}
+		else {
+			index = heap.top().second;
+			heap.pop();
+		}
+
+		const float level = dst[index];
+		const int x = (int)(index % cols);
+		const int y = (int)(index / cols);
+		for (int n = 0; n < neighbours; n++) {
+			const int nx = x + DX[n];
+			const int ny = y + DY[n];
+			if (nx < 0 || ny < 0 || nx >= cols || ny >= rows) {
+				continue;
+			}
+			const size_t nIndex = (size_t)ny * cols + nx;
+			if (m_visited[nIndex >> 6] & (uint64_t(1) << (nIndex & 63))) {
+				continue;
+			}
+			mark(nIndex);
+
+			const float elevation = m_elevation.at<float>(ny, nx);
+			if (m_outOfBounds.at<uchar>(ny, nx) || std::isnan(elevation)) {
+				continue;
+			}
+			if (elevation <= level) {
+				dst[nIndex] = level;
+				pit.push_back(nIndex);
+			}
+			else {
+				dst[nIndex] = elevation;
+				heap.push(Cell(elevation, nIndex));
+			}
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Connected inundation over a registered elevation grid. Starting from ocean
+* seed cells, water reaches cells through 4 or 8 connected neighbours; cells
+* outside the DEM never flood. Visited cells are tracked in a bitset, one
+* bit per cell.
+*
+* onset() answers every water level at once: a priority-flood from the
+* seeds gives each cell the lowest elevation it has to be crossed at, so a
+* cell floods at level L exactly when its onset is below L.
+*/
+class FloodFill
+{
+public:
+	enum Connectivity
+	{
+		FOUR_CONNECTED = 4,
+		EIGHT_CONNECTED = 8
+	};
+
+	FloodFill();
+
+	void setElevation(const cv::Mat& elevation, const cv::Mat& outOfBounds);
+	void setConnectivity(const Connectivity& connectivity);
+
+	size_t seedEdges(const double& seaLevel);
+	size_t seedMask(const cv::Mat& waterMask);
+
+	void onset(cv::Mat& onset);
+
+private:
+	void mark(const size_t& index);
+
+	cv::Mat m_elevation;/// CV_32FC1
+	cv::Mat m_outOfBounds;/// CV_8UC1, nonzero outside the DEM
+	Connectivity m_connectivity;
+	std::vector<cv::Point> m_seeds;
+	std::vector<uint64_t> m_visited;
+};
@@ -0,0 +1,105 @@
+#include "FloodOverlay.h"
+
+// OpenCV Headers
+#include <opencv2/imgproc.hpp>
+
+// C++ Standard Libraries
+#include <algorithm>
+
+FloodOverlay::FloodOverlay()
+{
+	setColor(cv::Vec3b(30, 90, 220), 10);
+}
+
+/*
+* Flood keys and elevations of the whole grid, shared rather than copied.
+* Active flooding keys cells by their onset, which is above the elevation
+* of cells in a depression, so the depth comes from the elevation.
+*/
+void FloodOverlay::setGrid(const cv::Mat& key, const cv::Mat& elevation)
+{
+	CV_Assert(key.type() == CV_32FC1);
+	CV_Assert(elevation.type() == CV_32FC1 && elevation.size() == key.size());
+	m_grid = key;
+	m_elevation = elevation;
+	m_view.release();
+	m_elevationView.release();
+	m_roi = cv::Rect();
+}
+
+bool FloodOverlay::hasGrid() const
+{
+	return !m_grid.empty();
+}
+
+/*
+* Water colour and the depth it is reached at; shallower water is more
+* transparent
+*/
+void FloodOverlay::setColor(const cv::Vec3b& rgb, const double& maxDepth)
+{
+	m_palette.assign(PALETTE_SIZE, 0);
+	for (int i = 1; i < PALETTE_SIZE; i++) {
+		const uint32_t alpha = 64 + 160 * i / (PALETTE_SIZE - 1);
+		m_palette[i] = (alpha << 24) | ((rgb[0] * alpha / 255) << 16) |
+			((rgb[1] * alpha / 255) << 8) | (rgb[2] * alpha / 255);
+	}
+	m_depthScale = (PALETTE_SIZE - 2) / std::max(maxDepth, 1e-3);
+}
+
+/*
+* Resample the visible part of the grid to the display size. Unchanged
+* views keep the previous samples; returns false when nothing is visible.
+*/
+bool FloodOverlay::setView(const cv::Rect& roi, const cv::Size& size)
+{
+	const cv::Rect rect = roi & cv::Rect(0, 0, m_grid.cols, m_grid.rows);
+	if (rect.empty() || size.area() <= 0) {
+		m_view.release();
+		m_elevationView.release();
+		m_roi = cv::Rect();
+		return false;
+	}
+
+	// never sample finer than the grid itself
+	const cv::Size viewSize(std::min(size.width, rect.width), std::min(size.height, rect.height));
+	if (rect == m_roi && m_view.size() == viewSize) {
+		return true;
+	}
+
+	cv::resize(m_grid(rect), m_view, viewSize, 0, 0, cv::INTER_NEAREST);
+	cv::resize(m_elevation(rect), m_elevationView, viewSize, 0, 0, cv::INTER_NEAREST);
+	m_roi = rect;
+	return true;
+}
+
+const cv::Rect& FloodOverlay::viewRect() const
+{
+	return m_roi;
+}
+
+/*
+* Colour the view at a water level as premultiplied ARGB words
+* (QImage::Format_ARGB32_Premultiplied), transparent where it is dry
+*/
+void FloodOverlay::render(const double& waterLevel, cv::Mat& argb) const
+{
+	argb.create(m_view.size(), CV_8UC4);
+	const float level = (float)waterLevel;
+	const float scale = (float)m_depthScale;
+	const uint32_t *palette = m_palette.data();
+
+	for (int y = 0; y < m_view.rows; y++) {
+		const float *key = m_view.ptr<float>(y);
+		const float *elevation = m_elevationView.ptr<float>(y);
+		uint32_t *out = argb.ptr<uint32_t>(y);
+		for (int x = 0; x < m_view.cols; x++) {
+			// dry cells (and NaN keys) land on entry 0; flooded ones are at
+			// least entry 1 whatever their depth
+			const float above = level - elevation[x];
+			const float depth = above > 0 ? above : 0.0f;
+			const int index = level > key[x] ? 1 + (int)std::min(depth * scale, (float)(PALETTE_SIZE - 2)) : 0;
+			out[x] = palette[index];
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// C++ Standard Libraries
+#include <cstdint>
+#include <vector>
+
+/**
+* Live flood overlay of a registered grid at a freely chosen water level.
+* The flood key of every cell (its flood onset, or its elevation for passive
+* flooding; +inf where it never floods) and its elevation are resampled once
+* per view to the display resolution of the visible region. Each frame then
+* only thresholds the small key grid and colours the flooded cells by their
+* depth below the water level through a palette lookup, so dragging the
+* water level costs a few milliseconds regardless of the scene size.
+*/
+class FloodOverlay
+{
+public:
+	static const int PALETTE_SIZE = 256;
+
+	FloodOverlay();
+
+	void setGrid(const cv::Mat& key, const cv::Mat& elevation);
+	bool hasGrid() const;
+	void setColor(const cv::Vec3b& rgb, const double& maxDepth);
+
+	bool setView(const cv::Rect& roi, const cv::Size& size);
+	const cv::Rect& viewRect() const;
+
+	void render(const double& waterLevel, cv::Mat& argb) const;
+
+private:
+	cv::Mat m_grid;/// CV_32FC1 flood key on the landsat grid
+	cv::Mat m_elevation;/// CV_32FC1 elevation on the landsat grid
+	cv::Mat m_view;/// m_grid under m_roi, resampled to the display size
+	cv::Mat m_elevationView;/// m_elevation resampled like m_view
+	cv::Rect m_roi;
+	std::vector<uint32_t> m_palette;/// Premultiplied ARGB by depth step, 0 is dry
+	double m_depthScale;/// Palette steps per metre of depth
+};
@@ -0,0 +1,193 @@
+#include "GeoTiffWriter.h"
+
+// User Headers
+#include "Profiler.h"
+
+GeoTiffWriter::GeoTiffWriter()
+{
+	m_dataset = NULL;
+	m_pending = 0;
+	m_maxPending = 256 * 1024 * 1024;
+	m_closing = false;
+	m_failed = false;
+}
+
+GeoTiffWriter::~GeoTiffWriter()
+{
+	close();
+}
+
+const char *GeoTiffWriter::compression()
+{
+	GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+	const char *options = driver != NULL ? driver->GetMetadataItem(GDAL_DMD_CREATIONOPTIONLIST) : NULL;
+	return options != NULL && strstr(options, "ZSTD") != NULL ? "ZSTD" : "DEFLATE";
+}
+
+/*
+* Create the file with the grid, georeferencing and layout of the output,
+* then start the encoding thread
+*/
+bool GeoTiffWriter::open(const QString& fileName, const cv::Size& size, const int& bands, const GDALDataType& type,
+	const double *geoTransform, const char *projection, const int& blockSize)
+{
+	close();
+
+	GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+	if (driver == NULL) {
+		return false;
+	}
+
+	const QByteArray block = QByteArray::number(blockSize);
+	const bool floating = type == GDT_Float32 || type == GDT_Float64;
+	char **options = NULL;
+	options = CSLSetNameValue(options, "TILED", "YES");
+	options = CSLSetNameValue(options, "BLOCKXSIZE", block.constData());
+	options = CSLSetNameValue(options, "BLOCKYSIZE", block.constData());
+	options = CSLSetNameValue(options, "COMPRESS", compression());
+	options = CSLSetNameValue(options, "PREDICTOR", floating ? "3" : "2");
+	options = CSLSetNameValue(options, "NUM_THREADS", "ALL_CPUS");
+	options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+	if (bands == 3 && type == GDT_Byte) {
+		options = CSLSetNameValue(options, "PHOTOMETRIC", "RGB");
+	}
+
+	m_dataset = driver->Create(fileName.toLocal8Bit().constData(),
+		size.width, size.height, bands, type, options);
+	CSLDestroy(options);
+	if (m_dataset == NULL) {
+		return false;
+	}
+
+	double transform[6];
+	std::copy(geoTransform, geoTransform + 6, transform);
+	m_dataset->SetGeoTransform(transform);
+	m_dataset->SetProjection(projection);
+
+	m_closing = false;
+	m_failed = false;
+	m_thread = std::thread(&GeoTiffWriter::run, this);
+	return true;
+}
+
+/*
+* No data value of every band; set it before the first write
+*/
+void GeoTiffWriter::setNoData(const double& value)
+{
+	if (m_dataset == NULL) { return; }
+	for (int i = 1; i <= m_dataset->GetRasterCount(); i++) {
+		m_dataset->GetRasterBand(i)->SetNoDataValue(value);
+	}
+}
+
+void GeoTiffWriter::setMaxPending(const size_t& bytes)
+{
+	QMutexLocker locker(&m_mutex);
+	m_maxPending = std::max<size_t>(bytes, 1);
+}
+
+/*
+* Queue a tile; blocks while the queue is full. The first tile is always
+* accepted, so tiles larger than the budget still go through.
+*/
+void GeoTiffWriter::write(const cv::Rect& tile, const cv::Mat& image, const bool& bgr)
+{
+	if (m_dataset == NULL) { return; }
+
+	const size_t bytes = image.total() * image.elemSize();
+	QMutexLocker locker(&m_mutex);
+	while (!m_jobs.empty() && m_pending + bytes > m_maxPending) {
+		m_written.wait(&m_mutex);
+	}
+
+	const Job job = { tile, image, bgr };
+	m_jobs.push_back(job);
+	m_pending += bytes;
+	m_queued.wakeOne();
+}
+
+/*
+* Drain the queue, flush and close the file. Returns false when a tile
+* could not be written or the file could not be finished.
+*/
+bool GeoTiffWriter::close()
+{
+	if (m_dataset == NULL) { return !m_failed; }
+
+	{
+		QMutexLocker locker(&m_mutex);
+		m_closing = true;
+		m_queued.wakeOne();
+	}
+	m_thread.join();
+
+	ScopedTimer timer("GeoTiffWriter::close", "encoding");
+	if (m_dataset->FlushCache() != CE_None) {
+		m_failed = true;
+	}
+	GDALClose(m_dataset);
+	m_dataset = NULL;
+	return !m_failed;
+}
+
+bool GeoTiffWriter::isOpen() const
+{
+	return m_dataset != NULL;
+}
+
+void GeoTiffWriter::run()
+{
+	for (;;) {
+		Job job;
+		{
+			QMutexLocker locker(&m_mutex);
+			while (m_jobs.empty() && !m_closing) {
+				m_queued.wait(&m_mutex);
+			}
+			if (m_jobs.empty()) { return; }
+			job = m_jobs.front();
+		}
+
+		// keep writing after a failure so producers never block forever
+		if (!m_failed && !writeJob(job)) {
+			m_failed = true;
+		}
+
+		QMutexLocker locker(&m_mutex);
+		m_pending -= job.image.total() * job.image.elemSize();
+		m_jobs.pop_front();
+		m_written.wakeAll();
+	}
+}
+
+/*
+* Write one tile, one band per channel, swapping blue and red when the
+* tile is BGR
+*/
+bool GeoTiffWriter::writeJob(const Job& job)
+{
+	ScopedTimer timer("GeoTiffWriter::write", "encoding");
+
+	const cv::Mat& image = job.image;
+	const int bands = image.channels();
+	if (bands != m_dataset->GetRasterCount() || bands > 4) { return false; }
+
+	int bandMap[4] = { 1, 2, 3, 4 };
+	if (job.bgr && bands >= 3) { std::swap(bandMap[0], bandMap[2]); }
+
+	GDALDataType type = GDT_Byte;
+	switch (image.depth()) {
+	case CV_8U: type = GDT_Byte; break;
+	case CV_16U: type = GDT_UInt16; break;
+	case CV_16S: type = GDT_Int16; break;
+	case CV_32S: type = GDT_Int32; break;
+	case CV_32F: type = GDT_Float32; break;
+	case CV_64F: type = GDT_Float64; break;
+	default: return false;
+	}
+
+	return m_dataset->RasterIO(GF_Write, job.tile.x, job.tile.y, job.tile.width, job.tile.height,
+		image.data, image.cols, image.rows, type, bands, bandMap,
+		(GSpacing)image.elemSize(), (GSpacing)image.step, (GSpacing)image.elemSize1()) == CE_None;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// GDAL Headers
+#include <gdal_priv.h>
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+/**
+* Tiled, compressed GeoTIFF written from a background thread. Tiles are
+* queued by write() and encoded while the caller computes the next ones;
+* the queue is bounded in bytes, so a producer that outruns the encoder
+* waits instead of piling up tiles. Queued images are held by reference,
+* callers must not write into them afterwards. ZSTD is used when the GTiff
+* driver was built with it, DEFLATE otherwise.
+*/
+class GeoTiffWriter
+{
+public:
+	GeoTiffWriter();
+	~GeoTiffWriter();
+
+	bool open(const QString& fileName, const cv::Size& size, const int& bands, const GDALDataType& type,
+		const double *geoTransform, const char *projection, const int& blockSize = 256);
+	void setNoData(const double& value);
+	void setMaxPending(const size_t& bytes);
+
+	void write(const cv::Rect& tile, const cv::Mat& image, const bool& bgr = false);
+	bool close();
+	bool isOpen() const;
+
+	static const char *compression();
+
+private:
+	struct Job
+	{
+		cv::Rect tile;
+		cv::Mat image;
+		bool bgr;
+	};
+
+	void run();
+	bool writeJob(const Job& job);
+
+	GDALDataset *m_dataset;
+	std::thread m_thread;
+	std::deque<Job> m_jobs;
+	size_t m_pending;/// Bytes of the queued images
+	size_t m_maxPending;
+	bool m_closing;
+	std::atomic<bool> m_failed;
+	QMutex m_mutex;
+	QWaitCondition m_queued;
+	QWaitCondition m_written;
+};
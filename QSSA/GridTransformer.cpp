@@ -0,0 +1,282 @@
+#include "GridTransformer.h"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+GridTransformer::GridTransformer()
+{
+	m_transform = NULL;
+	m_tolerance = 0.125;
+	m_step = 64;
+}
+
+GridTransformer::~GridTransformer()
+{
+	if (m_transform != NULL) {
+		OGRCoordinateTransformation::DestroyCT(m_transform);
+	}
+}
+
+/*
+* Build the transformation from the source to the target dataset CRS
+*/
+bool GridTransformer::init(GDALDataset *source, GDALDataset *target)
+{
+	if (m_transform != NULL) {
+		OGRCoordinateTransformation::DestroyCT(m_transform);
+		m_transform = NULL;
+	}
+
+	double targetGeoTransform[6];
+	if (source->GetGeoTransform(m_sourceGeoTransform) != CE_None ||
+		target->GetGeoTransform(targetGeoTransform) != CE_None ||
+		!GDALInvGeoTransform(targetGeoTransform, m_targetInverse)) {
+		return false;
+	}
+
+	OGRSpatialReference sourceSRS;
+	OGRSpatialReference targetSRS;
+	if (sourceSRS.SetFromUserInput(source->GetProjectionRef()) != OGRERR_NONE ||
+		targetSRS.SetFromUserInput(target->GetProjectionRef()) != OGRERR_NONE) {
+		return false;
+	}
+#if GDAL_VERSION_MAJOR >= 3
+	// geotransforms are always x = easting / longitude
+	sourceSRS.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+	targetSRS.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#endif
+
+	m_transform = OGRCreateCoordinateTransformation(&sourceSRS, &targetSRS);
+	return m_transform != NULL;
+}
+
+void GridTransformer::setTolerance(const double& pixels)
+{
+	m_tolerance = std::max(0.0, pixels);
+}
+
+void GridTransformer::setStep(const int& pixels)
+{
+	m_step = std::max(2, pixels);
+}
+
+/*
+* Exactly transform source pixel positions, in place, to target pixel
+* positions. Points that fail become NaN.
+*/
+bool GridTransformer::transform(const int& count, double *x, double *y) const
+{
+	if (count <= 0) {
+		return true;
+	}
+
+	const double *gt = m_sourceGeoTransform;
+	for (int i = 0; i < count; i++) {
+		const double px = x[i];
+		const double py = y[i];
+		x[i] = gt[0] + px * gt[1] + py * gt[2];
+		y[i] = gt[3] + px * gt[4] + py * gt[5];
+	}
+
+	std::vector<int> success(count, 0);
+	const bool ok = m_transform->Transform(count, x, y, NULL, &success[0]) != 0;
+
+	const double *inv = m_targetInverse;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	for (int i = 0; i < count; i++) {
+		if (!success[i]) {
+			x[i] = nan;
+			y[i] = nan;
+			continue;
+		}
+		const double wx = x[i];
+		const double wy = y[i];
+		x[i] = inv[0] + wx * inv[1] + wy * inv[2];
+		y[i] = inv[3] + wx * inv[4] + wy * inv[5];
+	}
+	return ok;
+}
+
+GridTransformer::Node GridTransformer::exact(const int& x, const int& y) const
+{
+	Node node;
+	node.x = x;
+	node.y = y;
+	transform(1, &node.x, &node.y);
+	return node;
+}
+
+/*
+* Control grid of a tile: every m_step pixels plus the last row and column,
+* transformed in one batch
+*/
+void GridTransformer::controlGrid(const cv::Rect& tile, std::vector<int>& xs, std::vector<int>& ys, std::vector<Node>& nodes) const
+{
+	xs.clear();
+	ys.clear();
+	for (int x = tile.x; x < tile.x + tile.width - 1; x += m_step) { xs.push_back(x); }
+	xs.push_back(tile.x + tile.width - 1);
+	for (int y = tile.y; y < tile.y + tile.height - 1; y += m_step) { ys.push_back(y); }
+	ys.push_back(tile.y + tile.height - 1);
+
+	// a one pixel wide tile still gets a (degenerate) cell
+	if (xs.size() == 1) { xs.push_back(xs[0]); }
+	if (ys.size() == 1) { ys.push_back(ys[0]); }
+
+	std::vector<double> gx(xs.size() * ys.size());
+	std::vector<double> gy(gx.size());
+	for (size_t j = 0; j < ys.size(); j++) {
+		for (size_t i = 0; i < xs.size(); i++) {
+			gx[j * xs.size() + i] = xs[i];
+			gy[j * xs.size() + i] = ys[j];
+		}
+	}
+	transform((int)gx.size(), &gx[0], &gy[0]);
+
+	nodes.resize(gx.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nodes[i].x = gx[i];
+		nodes[i].y = gy[i];
+	}
+}
+
+/*
+* Target pixel rectangle covered by a source tile, padded by the tolerance
+*/
+cv::Rect GridTransformer::bounds(const cv::Rect& tile) const
+{
+	if (tile.width <= 0 || tile.height <= 0) {
+		return cv::Rect();
+	}
+
+	std::vector<int> xs;
+	std::vector<int> ys;
+	std::vector<Node> nodes;
+	controlGrid(tile, xs, ys, nodes);
+
+	double minX = std::numeric_limits<double>::max();
+	double minY = std::numeric_limits<double>::max();
+	double maxX = -std::numeric_limits<double>::max();
+	double maxY = -std::numeric_limits<double>::max();
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (std::isnan(nodes[i].x) || std::isnan(nodes[i].y)) {
+			continue;
+		}
+		minX = std::min(minX, nodes[i].x);
+		minY = std::min(minY, nodes[i].y);
+		maxX = std::max(maxX, nodes[i].x);
+		maxY = std::max(maxY, nodes[i].y);
+	}
+	if (minX > maxX) {
+		return cv::Rect();
+	}
+
+	// the curve between control points may bulge past them by the tolerance
+	const double pad = m_tolerance + 1;
+	return cv::Rect(cv::Point(cvFloor(minX - pad), cvFloor(minY - pad)),
+		cv::Point(cvCeil(maxX + pad) + 1, cvCeil(maxY + pad) + 1));
+}
+
+/**
+* Fill the registration maps of a tile with target pixel positions minus
+* offset, interpolating between control points where that is accurate
+* enough.
+*/
+void GridTransformer::mapTile(const cv::Rect& tile, const cv::Point& offset, cv::Mat& mapX, cv::Mat& mapY) const
+{
+	mapX.create(tile.size(), CV_32FC1);
+	mapY.create(tile.size(), CV_32FC1);
+	if (tile.width <= 0 || tile.height <= 0) {
+		return;
+	}
+
+	std::vector<int> xs;
+	std::vector<int> ys;
+	std::vector<Node> nodes;
+	controlGrid(tile, xs, ys, nodes);
+
+	const size_t columns = xs.size();
+	for (size_t j = 0; j + 1 < ys.size(); j++) {
+		for (size_t i = 0; i + 1 < columns; i++) {
+			const Node corners[4] = {
+				nodes[j * columns + i], nodes[j * columns + i + 1],
+				nodes[(j + 1) * columns + i], nodes[(j + 1) * columns + i + 1]
+			};
+			fillCell(xs[i], ys[j], xs[i + 1], ys[j + 1], corners, tile, offset, mapX, mapY);
+		}
+	}
+}
+
+/*
+* Fill the pixels of one cell, corners ordered top left, top right, bottom
+* left, bottom right. Bounds are inclusive.
+*/
+void GridTransformer::fillCell(const int& x0, const int& y0, const int& x1, const int& y1, const Node corners[4],
+	const cv::Rect& tile, const cv::Point& offset, cv::Mat& mapX, cv::Mat& mapY) const
+{
+	bool valid = true;
+	for (int i = 0; i < 4; i++) {
+		valid = valid && !std::isnan(corners[i].x) && !std::isnan(corners[i].y);
+	}
+
+	// small cells are transformed exactly, pixel by pixel
+	if (x1 - x0 <= 2 && y1 - y0 <= 2) {
+		for (int y = y0; y <= y1; y++) {
+			float *mx = mapX.ptr<float>(y - tile.y);
+			float *my = mapY.ptr<float>(y - tile.y);
+			for (int x = x0; x <= x1; x++) {
+				const Node node = exact(x, y);
+				mx[x - tile.x] = (float)(node.x - offset.x);
+				my[x - tile.x] = (float)(node.y - offset.y);
+			}
+		}
+		return;
+	}
+
+	// compare the exact centre with the interpolated one
+	const int cx = (x0 + x1) / 2;
+	const int cy = (y0 + y1) / 2;
+	const Node centre = exact(cx, cy);
+	if (valid && !std::isnan(centre.x)) {
+		const double u = x1 > x0 ? double(cx - x0) / (x1 - x0) : 0;
+		const double v = y1 > y0 ? double(cy - y0) / (y1 - y0) : 0;
+		const double ix = (1 - v) * ((1 - u) * corners[0].x + u * corners[1].x) + v * ((1 - u) * corners[2].x + u * corners[3].x);
+		const double iy = (1 - v) * ((1 - u) * corners[0].y + u * corners[1].y) + v * ((1 - u) * corners[2].y + u * corners[3].y);
+		if (std::abs(ix - centre.x) <= m_tolerance && std::abs(iy - centre.y) <= m_tolerance) {
+			const double width = std::max(1, x1 - x0);
+			const double height = std::max(1, y1 - y0);
+			for (int y = y0; y <= y1; y++) {
+				const double t = (y - y0) / height;
+				const double lx = (1 - t) * corners[0].x + t * corners[2].x - offset.x;
+				const double ly = (1 - t) * corners[0].y + t * corners[2].y - offset.y;
+				const double rx = (1 - t) * corners[1].x + t * corners[3].x - offset.x;
+				const double ry = (1 - t) * corners[1].y + t * corners[3].y - offset.y;
+				float *mx = mapX.ptr<float>(y - tile.y);
+				float *my = mapY.ptr<float>(y - tile.y);
+				for (int x = x0; x <= x1; x++) {
+					const double s = (x - x0) / width;
+					mx[x - tile.x] = (float)((1 - s) * lx + s * rx);
+					my[x - tile.x] = (float)((1 - s) * ly + s * ry);
+				}
+			}
+			return;
+		}
+	}
+
+	// otherwise split in four around the centre
+	const Node top = exact(cx, y0);
+	const Node bottom = exact(cx, y1);
+	const Node left = exact(x0, cy);
+	const Node right = exact(x1, cy);
+	const Node topLeft[4] = { corners[0], top, left, centre };
+	const Node topRight[4] = { top, corners[1], centre, right };
+	const Node bottomLeft[4] = { left, centre, corners[2], bottom };
+	const Node bottomRight[4] = { centre, right, bottom, corners[3] };
+	fillCell(x0, y0, cx, cy, topLeft, tile, offset, mapX, mapY);
+	fillCell(cx, y0, x1, cy, topRight, tile, offset, mapX, mapY);
+	fillCell(x0, cy, cx, y1, bottomLeft, tile, offset, mapX, mapY);
+	fillCell(cx, cy, x1, y1, bottomRight, tile, offset, mapX, mapY);
+}
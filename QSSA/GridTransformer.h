@@ -0,0 +1,52 @@
+#pragma once
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// GDAL Headers
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+
+// C++ Standard Libraries
+#include <vector>
+
+/**
+* Maps source raster pixels onto target raster pixels across coordinate
+* reference systems. The exact OGR transformation is only evaluated on a
+* sparse control grid; cells in between are interpolated bilinearly as long
+* as the error at the cell centre stays within the tolerance, and are split
+* in four otherwise, the same trade as GDAL's approximate transformer.
+* Points the transformation cannot reach map to NaN.
+*/
+class GridTransformer
+{
+public:
+	GridTransformer();
+	~GridTransformer();
+
+	bool init(GDALDataset *source, GDALDataset *target);
+	void setTolerance(const double& pixels);
+	void setStep(const int& pixels);
+
+	bool transform(const int& count, double *x, double *y) const;
+	cv::Rect bounds(const cv::Rect& tile) const;
+	void mapTile(const cv::Rect& tile, const cv::Point& offset, cv::Mat& mapX, cv::Mat& mapY) const;
+
+private:
+	struct Node
+	{
+		double x;
+		double y;
+	};
+
+	Node exact(const int& x, const int& y) const;
+	void fillCell(const int& x0, const int& y0, const int& x1, const int& y1, const Node corners[4],
+		const cv::Rect& tile, const cv::Point& offset, cv::Mat& mapX, cv::Mat& mapY) const;
+	void controlGrid(const cv::Rect& tile, std::vector<int>& xs, std::vector<int>& ys, std::vector<Node>& nodes) const;
+
+	OGRCoordinateTransformation *m_transform;
+	double m_sourceGeoTransform[6];
+	double m_targetInverse[6];
+	double m_tolerance;/// Allowed interpolation error, in target pixels
+	int m_step;/// Control grid spacing, in source pixels
+};
@@ -216,6 +216,72 @@ void write_pixel(const double& pixelValue,
 }
 
 
+/**
+* Row converter: write one row of a band into its channel of an interleaved
+* image row. Cn is the image channel count, or 0 when it is only known at
+* runtime; with Cn == 1 the loop is a plain contiguous copy the compiler can
+* vectorize. range_cast is the identity for every type pair gdal2opencv
+* produces, so a static_cast is all that is left per sample.
+*/
+template<typename SrcT, typename DstT, int Cn>
+void convert_row(const void* src, void* dst,
+	const int& cols,
+	const int& channels,
+	const int& channel)
+{
+	const SrcT* s = static_cast<const SrcT*>(src);
+	DstT* d = static_cast<DstT*>(dst) + channel;
+	const int step = Cn > 0 ? Cn : channels;
+
+	for (int x = 0; x < cols; x++) {
+		d[x * step] = static_cast<DstT>(s[x]);
+	}
+}
+
+template<typename SrcT, typename DstT>
+RowConverter select_row_converter(const int& channels)
+{
+	switch (channels) {
+	case 1: return &convert_row<SrcT, DstT, 1>;
+	case 3: return &convert_row<SrcT, DstT, 3>;
+	case 4: return &convert_row<SrcT, DstT, 4>;
+	default: return &convert_row<SrcT, DstT, 0>;
+	}
+}
+
+RowConverter select_row_converter(const GDALDataType& gdalType,
+	const int& cvDepth,
+	const int& channels)
+{
+	switch (gdalType) {
+	case GDT_Byte:
+		if (cvDepth == CV_8U) { return select_row_converter<uchar, uchar>(channels); }
+		break;
+	case GDT_UInt16:
+		if (cvDepth == CV_16U) { return select_row_converter<unsigned short, unsigned short>(channels); }
+		break;
+	case GDT_Int16:
+		if (cvDepth == CV_16S) { return select_row_converter<short, short>(channels); }
+		break;
+	case GDT_UInt32:
+		if (cvDepth == CV_32S) { return select_row_converter<unsigned int, int>(channels); }
+		break;
+	case GDT_Int32:
+		if (cvDepth == CV_32S) { return select_row_converter<int, int>(channels); }
+		break;
+	case GDT_Float32:
+		if (cvDepth == CV_32F) { return select_row_converter<float, float>(channels); }
+		break;
+	case GDT_Float64:
+		if (cvDepth == CV_64F) { return select_row_converter<double, double>(channels); }
+		break;
+	default:
+		break;
+	}
+	return NULL;
+}
+
+
 void write_ctable_pixel(const double& pixelValue,
 	const GDALDataType& gdalType,
 	GDALColorTable const* gdalColorTable,
@@ -226,6 +292,7 @@ void write_ctable_pixel(const double& pixelValue,
 {
 	if (gdalColorTable == NULL) {
 		write_pixel(pixelValue, gdalType, 1, image, y, x, c);
+		return;
 	}
 
 	// if we are Grayscale, then do a straight conversion
@@ -267,7 +334,7 @@ void write_ctable_pixel(const double& pixelValue,
 		write_pixel(g, gdalType, 4, image, y, x, 1);
 		write_pixel(b, gdalType, 4, image, y, x, 2);
 		if (image.channels() > 3) {
-			write_pixel(a, gdalType, 4, image, y, x, 1);
+			write_pixel(a, gdalType, 4, image, y, x, 3);
 		}
 	}
 
@@ -279,8 +346,125 @@ void write_ctable_pixel(const double& pixelValue,
 }
 
 
+/**
+* Read all bands with one band-interleaved RasterIO call straight into the
+* image buffer, letting GDAL do the only conversion (none, when the on-disk
+* type already matches the image depth). Returns false when the layout is
+* not one of the supported fast cases, so the caller can use the generic path.
+* The region roi is resampled to the image size when the two differ.
+*/
+bool read_direct(GDALDataset* dataset,
+	const GDALDataType& gdalType,
+	const QList<int>& colors,
+	const cv::Rect& roi,
+	Mat& image)
+{
+	// only native types whose range_cast is the identity
+	if (gdalType != GDT_Byte && gdalType != GDT_UInt16 &&
+		gdalType != GDT_Int16 && gdalType != GDT_Float32) {
+		return false;
+	}
+
+	// only gray, RGB and RGBA layouts
+	const int nBands = colors.size();
+	if (nBands != 1 && nBands != 3 && nBands != 4) { return false; }
+	if (image.channels() != nBands || image.depth() != CV_MAT_DEPTH(gdal2opencv(gdalType, 1))) { return false; }
+
+	// every channel has to be fed by exactly one band of the same type
+	int bandMap[4] = { 0, 0, 0, 0 };
+	for (int c = 0; c < nBands; c++) {
+		if (dataset->GetRasterBand(c + 1)->GetRasterDataType() != gdalType) { return false; }
+		if (colors.at(c) >= nBands || bandMap[colors.at(c)] != 0) { return false; }
+		bandMap[colors.at(c)] = c + 1;
+	}
+
+	// pixel, line and band spacing of the interleaved cv::Mat
+	CPLErr err = dataset->RasterIO(GF_Read, roi.x, roi.y, roi.width, roi.height,
+		image.data, image.cols, image.rows, gdalType, nBands, bandMap,
+		(GSpacing)image.elemSize(), (GSpacing)image.step, (GSpacing)image.elemSize1());
+
+	return err == CE_None;
+}
+
+
+/**
+* Expand a paletted band through a lookup table built once per dataset.
+* Byte indices into an 8-bit table go through cv::LUT; everything else is
+* a plain gather of whole table entries.
+*/
+bool read_palette(GDALRasterBand* band,
+	const Mat& lut,
+	const cv::Rect& roi,
+	Mat& image)
+{
+	int nBlockXSize, nBlockYSize;
+	band->GetBlockSize(&nBlockXSize, &nBlockYSize);
+
+	const bool byteIndex = lut.cols == 256;
+	const size_t entrySize = lut.elemSize();
+
+	// start at the block holding the top left corner of the region
+	const int startX = roi.x - roi.x % nBlockXSize;
+	const int startY = roi.y - roi.y % nBlockYSize;
+
+	Mat index;
+	for (int blockY = startY; blockY < roi.y + roi.height; blockY += nBlockYSize) {
+
+		const int by = std::max(blockY, roi.y);
+		const int nRows = std::min(blockY + nBlockYSize, roi.y + roi.height) - by;
+
+		for (int blockX = startX; blockX < roi.x + roi.width; blockX += nBlockXSize) {
+
+			const int bx = std::max(blockX, roi.x);
+			const int nCols = std::min(blockX + nBlockXSize, roi.x + roi.width) - bx;
+
+			// read the palette indices of the window
+			index.create(nRows, nCols, byteIndex ? CV_8UC1 : CV_16UC1);
+			CPLErr err = band->RasterIO(GF_Read, bx, by, nCols, nRows,
+				index.data, nCols, nRows, byteIndex ? GDT_Byte : GDT_UInt16, 0, (GSpacing)index.step);
+			if (err != CE_None) { return false; }
+
+			Mat dst = image(cv::Rect(bx - roi.x, by - roi.y, nCols, nRows));
+
+			if (byteIndex && lut.depth() == CV_8U) {
+				// cv::LUT wants as many index channels as the table has
+				if (lut.channels() == 1) {
+					cv::LUT(index, lut, dst);
+				}
+				else {
+					std::vector<Mat> planes(lut.channels(), index);
+					Mat expanded;
+					cv::merge(planes, expanded);
+					cv::LUT(expanded, lut, dst);
+				}
+				continue;
+			}
+
+			for (int y = 0; y < nRows; y++) {
+				uchar* d = dst.ptr(y);
+				const uchar* table = lut.ptr();
+				if (byteIndex) {
+					const uchar* s = index.ptr<uchar>(y);
+					for (int x = 0; x < nCols; x++) { memcpy(d + x * entrySize, table + s[x] * entrySize, entrySize); }
+				}
+				else {
+					const unsigned short* s = index.ptr<unsigned short>(y);
+					for (int x = 0; x < nCols; x++) { memcpy(d + x * entrySize, table + s[x] * entrySize, entrySize); }
+				}
+			}
+		}
+	}
+	return true;
+}
+
 MapLayer::MapLayer()
 {
+	m_lazy = false;
+	m_tileSize = 512;
+	m_ioThreads = 1;
+	m_virtualMem = NULL;
+	m_cancel = false;
+	m_statsCancel = false;
 }
 
 MapLayer::MapLayer(const QString fileName)
@@ -292,10 +476,30 @@ MapLayer::MapLayer(const QString fileName)
 
 	imgMetaModel = new QStandardItemModel;
 	m_filename = fileName;
+
+	m_lazy = false;
+	m_tileSize = 512;
+	m_ioThreads = 1;
+	m_virtualMem = NULL;
+	m_cancel = false;
+	m_statsCancel = false;
 }
 
 MapLayer::~MapLayer()
 {
+	m_statsCancel = true;
+	if (m_statsThread.joinable()) { m_statsThread.join(); }
+
+	TileCache::instance()->remove(this);
+
+	// drop the mapped view before the dataset goes away
+	if (m_virtualMem != NULL)
+	{
+		m_image.release();
+		CPLVirtualMemFree(m_virtualMem);
+		m_virtualMem = NULL;
+	}
+
 	if (m_dataset != NULL)
 	{
 		GDALClose((GDALDatasetH)m_dataset);
@@ -314,11 +518,49 @@ QList<QStandardItem*> MapLayer::prepareRow(const QString & first, const QString
 
 void MapLayer::initMatData()
 {
+	// uncompressed rasters are used in place, pages fault in on first touch
+	if (mapData()) {
+		m_lazy = false;
+		return;
+	}
+
+	// lazy layers never hold the full resolution image
+	if (m_lazy) { return; }
+
 	m_image.create(m_height, m_width, m_cvType);
 }
 
+bool MapLayer::mapData()
+{
+	// only single band rasters whose samples are stored as the image expects
+	if (m_channels != 1 || hasColorTable) { return false; }
+	if (m_gdType.at(0) == GDT_UInt32) { return false; }
+	if (!CPLIsVirtualMemFileMapAvailable()) { return false; }
+
+	// ask the driver for its native file mapping only; drivers that would
+	// have to decode (compressed, tiled, swapped byte order) return NULL
+	char **papszOptions = CSLSetNameValue(NULL, "USE_DEFAULT_IMPLEMENTATION", "NO");
+	int nPixelSpace;
+	GIntBig nLineSpace;
+	CPLVirtualMem *mem = m_bands.at(0)->GetVirtualMemAuto(GF_Read, &nPixelSpace, &nLineSpace, papszOptions);
+	CSLDestroy(papszOptions);
+	if (mem == NULL) { return false; }
+
+	// the mapping has to look like a cv::Mat: packed pixels, forward lines
+	const size_t elemSize = CV_ELEM_SIZE(m_cvType);
+	if ((size_t)nPixelSpace != elemSize || nLineSpace < (GIntBig)(m_width * elemSize)) {
+		CPLVirtualMemFree(mem);
+		return false;
+	}
+
+	m_image = Mat(m_height, m_width, m_cvType, CPLVirtualMemGetAddr(mem), (size_t)nLineSpace);
+	m_virtualMem = mem;
+	return true;
+}
+
 bool MapLayer::readHeader()
 {
+	ScopedTimer timer("MapLayer::readHeader", "io");
 	// load the dataset
 	m_dataset = (GDALDataset *)GDALOpen(m_filename.toStdString().c_str(), GA_ReadOnly);
 
@@ -370,6 +612,9 @@ bool MapLayer::readHeader()
 				return false;
 			}
 			m_cvType = tempType;
+
+			// expand the palette into a lookup table once per dataset
+			buildPaletteLut();
 		}
 
 	}
@@ -388,29 +633,91 @@ bool MapLayer::readHeader()
 		m_cvType = tempType;
 	}
 
+	// get band statistics from the sidecar cache, or estimate them for the
+	// first display and run the exact pass in the background
+	if (!StatisticsCache::load(m_filename, m_channels, m_stats))
+	{
+		if (!StatisticsCache::approximate(m_dataset, m_stats)) { return false; }
+		if (!m_stats.first().approximate) { StatisticsCache::save(m_filename, m_stats); }
+	}
+
 	// get bands information of the dataset(block, min, max, type...)
 	GDALRasterBand *band;
 	QPair<int, int> nBlockSize;
-	int bGotMin, bGotMax;
-	double adfMinMax[2];
 	for (int i = 1; i <= m_dataset->GetRasterCount(); ++i)
 	{
 		band = m_dataset->GetRasterBand(i);
 		band->GetBlockSize(&nBlockSize.first, &nBlockSize.second);
-		adfMinMax[0] = band->GetMinimum(&bGotMin);
-		adfMinMax[1] = band->GetMaximum(&bGotMax);
-		GDALComputeRasterMinMax((GDALRasterBandH)band, TRUE, adfMinMax);
 
 		m_bands << band;
-		m_min << adfMinMax[0];
-		m_max << adfMinMax[1];
+		m_min << m_stats.at(i - 1).min;
+		m_max << m_stats.at(i - 1).max;
 		m_block << nBlockSize;
 		m_gdType << band->GetRasterDataType();//GDALGetDataTypeName(m_type);
 		m_colorInterp << band->GetColorInterpretation();//GDALGetColorInterpretationName(m_colorInterp);
 	}
+
+	if (m_stats.first().approximate) { computeStatistics(); }
 	return true;
 }
 
+/*
+* Exact statistics on a thread of their own, with a dataset handle of its
+* own. They go to the sidecar and replace the estimates on the layer's
+* thread; destroying the layer cancels the pass.
+*/
+void MapLayer::computeStatistics()
+{
+	m_statsCancel = true;
+	if (m_statsThread.joinable()) { m_statsThread.join(); }
+	m_statsCancel = false;
+
+	const QString fileName = m_filename;
+	m_statsThread = std::thread([this, fileName]() {
+		GDALDataset *dataset = (GDALDataset *)GDALOpen(fileName.toStdString().c_str(), GA_ReadOnly);
+		if (dataset == NULL) { return; }
+		QList<BandStatistics> stats;
+		const bool ok = StatisticsCache::compute(dataset, stats, &m_statsCancel);
+		GDALClose((GDALDatasetH)dataset);
+		if (!ok || m_statsCancel) { return; }
+
+		StatisticsCache::save(fileName, stats);
+		QMutexLocker locker(&m_statsMutex);
+		m_exactStats = stats;
+		QMetaObject::invokeMethod(this, "applyStatistics", Qt::QueuedConnection);
+	});
+}
+
+/*
+* Block until the background statistics pass, if any, is over
+*/
+void MapLayer::waitForStatistics()
+{
+	if (m_statsThread.joinable()) { m_statsThread.join(); }
+}
+
+void MapLayer::applyStatistics()
+{
+	QMutexLocker locker(&m_statsMutex);
+	if (m_exactStats.size() != m_channels) { return; }
+	m_stats = m_exactStats;
+	m_exactStats.clear();
+	for (int i = 0; i < m_stats.size() && i < m_min.size(); ++i)
+	{
+		m_min[i] = m_stats.at(i).min;
+		m_max[i] = m_stats.at(i).max;
+	}
+	locker.unlock();
+
+	// rebuild the metadata if it was shown with the estimates
+	if (imgMetaModel->rowCount() > 0)
+	{
+		imgMetaModel->clear();
+		setMetaModel();
+	}
+	emit statisticsChanged();
+}
+
 void MapLayer::setMetaModel()
 {
 	// Getting basic dataset information
@@ -476,29 +783,241 @@ void MapLayer::setMetaModel()
 		QList<QStandardItem *> minMaxRow = prepareRow("Min / Max", 
 			QString::number(m_min.at(i)) + " / " + QString::number(m_max.at(i)));
 		bandItem->appendRow(minMaxRow);
+
+		const BandStatistics& stats = m_stats.at(i);
+		QList<QStandardItem *> meanRow = prepareRow("Mean / StdDev",
+			QString::number(stats.mean) + " / " + QString::number(stats.stdDev) +
+			(stats.approximate ? tr(" (approximate)") : QString()));
+		bandItem->appendRow(meanRow);
+
+		// summarize the histogram in 16 ranges
+		QStandardItem *histogramItem = new QStandardItem("Histogram");
+		bandItem->appendRow(histogramItem);
+		const int binsPerRow = std::max(1, stats.histogram.size() / 16);
+		for (int j = 0; j < stats.histogram.size(); j += binsPerRow)
+		{
+			const int end = std::min(j + binsPerRow, stats.histogram.size());
+			quint64 count = 0;
+			for (int k = j; k < end; ++k) { count += stats.histogram.at(k); }
+			QList<QStandardItem *> binRow = prepareRow(
+				QString::number(stats.min + j * stats.binWidth()) + " - " +
+				QString::number(stats.min + end * stats.binWidth()),
+				QString::number(count));
+			histogramItem->appendRow(binRow);
+		}
 	}
 }
 
 bool MapLayer::readData()
 {
-	// set the image to zero
-	m_image = 0;
+	// lazy layers are read tile by tile on demand, mapped ones not at all
+	if (m_lazy || m_virtualMem != NULL) { return true; }
+	ScopedTimer timer("MapLayer::readData", "io");
+
+	// split the raster into strips of whole block rows
+	const int nBlockYSize = m_block.at(0).second;
+	const int nBlockRows = (m_height + nBlockYSize - 1) / nBlockYSize;
+	const int nThreads = std::max(1, std::min(m_ioThreads, nBlockRows));
+
+	// a few strips per thread keeps the workers balanced, and enough of them
+	// in total gives smooth progress and a quick response to cancel()
+	const int nStrips = std::min(nBlockRows, std::max(nThreads * 4, 32));
+	const int nStripRows = (nBlockRows + nStrips - 1) / nStrips * nBlockYSize;
+
+	m_image.create(m_height, m_width, m_cvType);
 
+	std::atomic<int> nextStrip(0);
+	std::atomic<int> rowsRead(0);
+	std::atomic<bool> succeeded(true);
+
+	// GDAL handles are not thread-safe, so every extra worker opens its own
+	// dataset; all of them read disjoint strips straight into m_image
+	auto worker = [&](bool ownHandle) {
+		GDALDataset *dataset = m_dataset;
+		if (ownHandle) {
+			dataset = (GDALDataset *)GDALOpen(m_filename.toStdString().c_str(), GA_ReadOnly);
+		}
+		if (dataset == NULL) {
+			succeeded = false;
+			return;
+		}
+
+		for (int strip = nextStrip++; strip < nStrips && succeeded && !m_cancel; strip = nextStrip++) {
+			const int y = strip * nStripRows;
+			if (y >= m_height) { break; }
+
+			const cv::Rect roi(0, y, m_width, std::min(nStripRows, m_height - y));
+			Mat rows = m_image.rowRange(roi.y, roi.y + roi.height);
+			if (!readRegion(dataset, roi, rows)) {
+				succeeded = false;
+			}
+
+			// report the rows finished so far
+			const int done = rowsRead += roi.height;
+			if (m_progress) { m_progress(done); }
+		}
+
+		if (ownHandle) {
+			GDALClose((GDALDatasetH)dataset);
+		}
+	};
+
+	// the calling thread takes part as one of the workers, on m_dataset
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nThreads; i++) {
+		threads.push_back(std::thread(worker, true));
+	}
+	worker(nThreads > 1);
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	return succeeded && !m_cancel;
+}
+
+bool MapLayer::readRegion(const cv::Rect& roi, Mat& image)
+{
+	return readRegion(m_dataset, roi, image);
+}
+
+bool MapLayer::readRegion(GDALDataset* dataset, const cv::Rect& roi, Mat& image)
+{
 	// iterate over each raster band
 	// note that OpenCV does bgr rather than rgb
 
 	GDALColorTable* gdalColorTable = NULL;
-	if (m_dataset->GetRasterBand(1)->GetColorTable() != NULL) {
-		gdalColorTable = m_dataset->GetRasterBand(1)->GetColorTable();
+	if (dataset->GetRasterBand(1)->GetColorTable() != NULL) {
+		gdalColorTable = dataset->GetRasterBand(1)->GetColorTable();
+	}
+
+	const GDALDataType gdalType = dataset->GetRasterBand(1)->GetRasterDataType();
+
+	// resolve the target channel of every band before touching any pixel
+	QList<int> colors;
+	if (!bandChannels(dataset, colors)) { return false; }
+
+	// the region has to lie inside the raster
+	if ((roi & cv::Rect(0, 0, m_width, m_height)) != roi) { return false; }
+	image.create(roi.size(), m_cvType);
+	Profiler::instance()->add(Profiler::BYTES_READ, (qint64)roi.area() * image.elemSize());
+
+	// common layouts go straight from GDAL into the image buffer
+	if (hasColorTable == false && read_direct(dataset, gdalType, colors, roi, image)) {
+		return true;
+	}
+
+	// single paletted bands expand through the lookup table
+	if (hasColorTable && m_channels == 1 && !m_paletteLut.empty()) {
+		return read_palette(dataset->GetRasterBand(1), m_paletteLut, roi, image);
+	}
+
+	// pick one row converter per band; bands without one (color tables and
+	// unusual type pairs) keep going through write_pixel
+	QList<RowConverter> converters;
+	for (int c = 0; c < m_channels; c++) {
+		converters << (hasColorTable ? NULL :
+			select_row_converter(m_gdType.at(c), image.depth(), m_channels));
+	}
+
+	// set the image to zero
+	image = 0;
+
+	// walk the region in the native block windows of the first band, so that
+	// every (possibly compressed) block is decoded exactly once. Bands are read
+	// inside the block loop, which keeps pixel-interleaved blocks hot in the
+	// GDAL block cache while all of their bands are consumed.
+	const int nBlockXSize = m_block.at(0).first;
+	const int nBlockYSize = m_block.at(0).second;
+
+	// create a temporary window buffer, large enough for any sample type
+	std::vector<double> window((size_t)nBlockXSize * nBlockYSize);
+
+	// start at the block holding the top left corner of the region
+	const int startX = roi.x - roi.x % nBlockXSize;
+	const int startY = roi.y - roi.y % nBlockYSize;
+
+	for (int blockY = startY; blockY < roi.y + roi.height; blockY += nBlockYSize) {
+
+		// clamp the window to the region
+		const int by = std::max(blockY, roi.y);
+		const int nRows = std::min(blockY + nBlockYSize, roi.y + roi.height) - by;
+
+		for (int blockX = startX; blockX < roi.x + roi.width; blockX += nBlockXSize) {
+
+			const int bx = std::max(blockX, roi.x);
+			const int nCols = std::min(blockX + nBlockXSize, roi.x + roi.width) - bx;
+
+			for (int c = 0; c < m_channels; c++) {
+
+				const RowConverter convert = converters.at(c);
+
+				// get the entire block window, in the native type if we can convert it
+				const GDALDataType bufType = convert != NULL ? m_gdType.at(c) : GDT_Float64;
+				CPLErr err = dataset->GetRasterBand(c + 1)->RasterIO(GF_Read, bx, by, nCols, nRows,
+					window.data(), nCols, nRows, bufType, 0, 0);
+				if (err != CE_None) { return false; }
+
+				// fast case: one tight loop per row
+				if (convert != NULL) {
+					const size_t rowBytes = (size_t)nCols * (GDALGetDataTypeSize(bufType) / 8);
+					for (int y = 0; y < nRows; y++) {
+						convert((const uchar*)window.data() + y * rowBytes,
+							image.ptr(by - roi.y + y) + (bx - roi.x) * image.elemSize(),
+							nCols, m_channels, colors.at(c));
+					}
+					continue;
+				}
+
+				// scatter the window inside the image
+				for (int y = 0; y < nRows; y++) {
+
+					const double* row = window.data() + (size_t)y * nCols;
+					for (int x = 0; x < nCols; x++) {
+
+						// set depending on image types
+						if (hasColorTable == false) {
+							write_pixel(row[x], gdalType, m_channels, image, by - roi.y + y, bx - roi.x + x, colors.at(c));
+						}
+						else {
+							write_ctable_pixel(row[x], gdalType, gdalColorTable, image, by - roi.y + y, bx - roi.x + x, colors.at(c));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void MapLayer::buildPaletteLut()
+{
+	GDALRasterBand *band = m_dataset->GetRasterBand(1);
+	GDALColorTable *gdalColorTable = band->GetColorTable();
+	const GDALDataType gdalType = band->GetRasterDataType();
+
+	// only Byte and UInt16 indices can address a table
+	m_paletteLut.release();
+	if (gdalColorTable == NULL || (gdalType != GDT_Byte && gdalType != GDT_UInt16)) { return; }
+
+	// entries missing from the color table stay black
+	const int nEntries = gdalType == GDT_Byte ? 256 : 65536;
+	m_paletteLut = Mat::zeros(1, nEntries, m_cvType);
+	for (int i = 0; i < nEntries; i++) {
+		if (gdalColorTable->GetPaletteInterpretation() == GPI_RGB && gdalColorTable->GetColorEntry(i) == NULL) {
+			continue;
+		}
+		write_ctable_pixel(i, gdalType, gdalColorTable, m_paletteLut, 0, i, 0);
 	}
+}
 
-	const GDALDataType gdalType = m_dataset->GetRasterBand(1)->GetRasterDataType();
-	
-	int nRows, nCols;
+bool MapLayer::bandChannels(GDALDataset* dataset, QList<int>& colors)
+{
+	colors.clear();
 	for (int c = 0; c < m_channels; c++) {
 
 		// get the GDAL Band
-		GDALRasterBand* band = m_dataset->GetRasterBand(c + 1);
+		GDALRasterBand* band = dataset->GetRasterBand(c + 1);
 
 		/* Map palette band and gray band to color index 0 and red, green,
 		blue, alpha bands to BGRA indexes. Note: ignoring HSL, CMY,
@@ -527,39 +1046,114 @@ bool MapLayer::readData()
 		// make sure the image band has the same dimensions as the image
 		if (band->GetXSize() != m_width || band->GetYSize() != m_height) { return false; }
 
-		// grab the raster size
-		nRows = band->GetYSize();
-		nCols = band->GetXSize();
+		colors << color;
+	}
+	return true;
+}
 
-		// create a temporary scanline pointer to store data
-		double* scanline = new double[nCols];
+void MapLayer::cancel()
+{
+	m_cancel = true;
+}
 
-		// iterate over each row and column
-		for (int y = 0; y < nRows; y++) {
+void MapLayer::setLazy(bool lazy)
+{
+	m_lazy = lazy;
+}
 
-			// get the entire row
-			CPLErr err = band->RasterIO(GF_Read, 0, y, nCols, 1, scanline, nCols, 1, GDT_Float64, 0, 0);
-			CV_Assert(err == CE_None);
+bool MapLayer::isLazy() const
+{
+	return m_lazy;
+}
 
-			// set inside the image
-			for (int x = 0; x < nCols; x++) {
+Mat MapLayer::readTile(const int& tx, const int& ty)
+{
+	const TileCache::Key key = { this, tx, ty };
 
-				// set depending on image types
-				//   given boost, I would use enable_if to speed up.  Avoid for now.
-				if (hasColorTable == false) {
-					write_pixel(scanline[x], gdalType, m_channels, m_image, y, x, color);
-				}
-				else {
-					write_ctable_pixel(scanline[x], gdalType, gdalColorTable, m_image, y, x, color);
-				}
-			}
+	Mat tile;
+	if (TileCache::instance()->get(key, tile)) {
+		return tile;
+	}
+	ScopedTimer timer("MapLayer::readTile", "io");
+
+	// GDAL handles are not thread-safe, so serialize the actual read
+	const cv::Rect rect = cv::Rect(tx * m_tileSize, ty * m_tileSize, m_tileSize, m_tileSize)
+		& cv::Rect(0, 0, m_width, m_height);
+	{
+		QMutexLocker locker(&m_ioMutex);
+		if (!readRegion(rect, tile)) { return Mat(); }
+	}
+
+	TileCache::instance()->put(key, tile);
+	return tile;
+}
+
+Mat MapLayer::window(const cv::Rect& roi)
+{
+	const cv::Rect rect = roi & cv::Rect(0, 0, m_width, m_height);
+
+	// resident layers hand out a view into the image
+	if (!m_lazy) {
+		return m_image(rect);
+	}
+
+	// lazy layers assemble the window from cached tiles
+	Mat output(rect.size(), m_cvType);
+	if (rect.empty()) { return output; }
+
+	for (int ty = rect.y / m_tileSize; ty <= (rect.y + rect.height - 1) / m_tileSize; ty++) {
+		for (int tx = rect.x / m_tileSize; tx <= (rect.x + rect.width - 1) / m_tileSize; tx++) {
+
+			Mat tile = readTile(tx, ty);
+			if (tile.empty()) { return Mat(); }
+
+			// copy the part of the tile that overlaps the window
+			const cv::Rect tileRect(tx * m_tileSize, ty * m_tileSize, tile.cols, tile.rows);
+			const cv::Rect overlap = tileRect & rect;
+			tile(overlap - tileRect.tl()).copyTo(output(overlap - rect.tl()));
 		}
+	}
+	return output;
+}
 
-		// delete our temp pointer
-		delete[] scanline;
+Mat MapLayer::overview(const cv::Size& size)
+{
+	// GDAL picks a suitable overview level when the buffer is smaller
+	ScopedTimer timer("MapLayer::overview", "io");
+	Mat image(size, m_cvType);
+	Profiler::instance()->add(Profiler::BYTES_READ, (qint64)size.area() * image.elemSize());
+	QList<int> colors;
+	if (bandChannels(m_dataset, colors) && !hasColorTable) {
+		QMutexLocker locker(&m_ioMutex);
+		const GDALDataType gdalType = m_dataset->GetRasterBand(1)->GetRasterDataType();
+		if (read_direct(m_dataset, gdalType, colors, cv::Rect(0, 0, m_width, m_height), image)) {
+			return image;
+		}
 	}
 
-	return true;
+	// paletted bands: decimate the indices, then expand them
+	if (hasColorTable && m_channels == 1 && !m_paletteLut.empty()) {
+		QMutexLocker locker(&m_ioMutex);
+		Mat index(size, CV_16UC1);
+		CPLErr err = m_bands.at(0)->RasterIO(GF_Read, 0, 0, m_width, m_height,
+			index.data, size.width, size.height, GDT_UInt16, 0, (GSpacing)index.step);
+		if (err != CE_None) { return Mat(); }
+
+		const size_t entrySize = m_paletteLut.elemSize();
+		for (int y = 0; y < size.height; y++) {
+			const unsigned short* s = index.ptr<unsigned short>(y);
+			uchar* d = image.ptr(y);
+			for (int x = 0; x < size.width; x++) {
+				memcpy(d + x * entrySize, m_paletteLut.ptr() + std::min<int>(s[x], m_paletteLut.cols - 1) * entrySize, entrySize);
+			}
+		}
+		return image;
+	}
+
+	// otherwise decimate the full resolution data, once there is some
+	if (!m_lazy && m_image.empty()) { return Mat(); }
+	cv::resize(window(cv::Rect(0, 0, m_width, m_height)), image, size, 0, 0, cv::INTER_NEAREST);
+	return image;
 }
 
 //bool MapLayer::getQImage()
@@ -610,10 +1204,17 @@ bool MapLayer::readData()
 
 QImage MapLayer::getQImage()
 {
+	// lazy layers are shown through a decimated copy that fits the screen
+	if (m_lazy && m_display.empty()) {
+		const double scale = std::min(1.0, 4096.0 / std::max(m_width, m_height));
+		m_display = overview(cv::Size(std::max(1, cvRound(m_width * scale)), std::max(1, cvRound(m_height * scale))));
+	}
+	const Mat& image = m_lazy ? m_display : m_image;
+
 	QImage imageDraw;
-	if (m_image.channels() == 1)
+	if (image.channels() == 1)
 	{
-		imageDraw = QImage(m_image.data, m_image.cols, m_image.rows, m_image.step, QImage::Format_Grayscale8);
+		imageDraw = QImage(image.data, image.cols, image.rows, image.step, QImage::Format_Grayscale8);
 		return imageDraw;
 		//if (image.depth() == CV_8U) {
 		//	imageDraw = QImage(image.data, image.cols, image.rows, image.step, QImage::Format_Grayscale8);
@@ -627,31 +1228,64 @@ QImage MapLayer::getQImage()
 		//	return imageDraw;
 		//}
 	}
-	else if (m_image.channels() == 3)
+	else if (image.channels() == 3)
 	{
-		if (m_image.depth() != CV_8U) {
-			QMessageBox::information(this, tr("Note!"),
-				tr("Formats with more than 8 bit per color channel will only be processed by the raster engine using 8 bit per color."));
+		if (image.depth() != CV_8U) {
+			m_lastError = tr("Formats with more than 8 bit per color channel will only be processed by the raster engine using 8 bit per color.");
 			return QImage();
 		}
 
-		imageDraw = QImage(m_image.data, m_image.cols, m_image.rows, m_image.step, QImage::Format_RGB888);
+		imageDraw = QImage(image.data, image.cols, image.rows, image.step, QImage::Format_RGB888);
 		return imageDraw;
 	}
-	else if (m_image.channels() == 4)
+	else if (image.channels() == 4)
 	{
-		if (m_image.depth() != CV_8U) {
-			QMessageBox::information(this, tr("Note!"),
-				tr("Formats with more than 8 bit per color channel will only be processed by the raster engine using 8 bit per color."));
+		if (image.depth() != CV_8U) {
+			m_lastError = tr("Formats with more than 8 bit per color channel will only be processed by the raster engine using 8 bit per color.");
 			return QImage();
 		}
 
-		m_imageDraw = QImage(m_image.data, m_image.cols, m_image.rows, m_image.step, QImage::Format_RGBA8888);
+		m_imageDraw = QImage(image.data, image.cols, image.rows, image.step, QImage::Format_RGBA8888);
 		return imageDraw;
 	}
 	else
 	{
-		QMessageBox::critical(this, tr("Error!"), tr("Unknown QImage format"));
+		m_lastError = tr("Unknown QImage format");
+		return QImage();
+	}
+}
+
+QImage MapLayer::toDisplayImage(const Mat& image) const
+{
+	if (image.empty()) { return QImage(); }
+
+	// stretch samples deeper than 8 bits, each channel with the range of
+	// its own band (band c fills channel c for gray and RGB(A) bands)
+	Mat display = image;
+	if (image.depth() != CV_8U && !m_min.isEmpty())
+	{
+		std::vector<Mat> channels;
+		cv::split(image, channels);
+		for (size_t c = 0; c < channels.size(); c++)
+		{
+			const int band = (int)c < m_min.size() && (int)c < m_max.size() ? (int)c : 0;
+			const double range = m_max.at(band) - m_min.at(band);
+			const double alpha = range > 0 ? 255.0 / range : 1.0;
+			channels[c].convertTo(channels[c], CV_8U, alpha, -m_min.at(band) * alpha);
+		}
+		cv::merge(channels, display);
+	}
+
+	// deep copy, the image may be handed to another thread
+	switch (display.channels())
+	{
+	case 1:
+		return QImage(display.data, display.cols, display.rows, display.step, QImage::Format_Grayscale8).copy();
+	case 3:
+		return QImage(display.data, display.cols, display.rows, display.step, QImage::Format_RGB888).copy();
+	case 4:
+		return QImage(display.data, display.cols, display.rows, display.step, QImage::Format_RGBA8888).copy();
+	default:
 		return QImage();
 	}
 }
@@ -1,27 +1,38 @@
 #pragma once
 
 // Qt Headers
-#include <QtWidgets>
+#include <QtCore>
+#include <QtGui>
 
 // GDAL Headers
 #include <gdal_priv.h>
 #include <cpl_conv.h>
+#include <cpl_virtualmem.h>
 #include <gdal.h>
 #include <gdal_utils.h>
 
 // OpenCV Headers
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc/types_c.h>
 
 // C++ Standard Libraries
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
+// User Headers
+#include "BandStatistics.h"
+#include "Profiler.h"
+#include "TileCache.h"
+
 // using namespace
 using namespace std;
 using namespace cv;
@@ -37,7 +48,32 @@ int gdalPaletteInterpretation2OpenCV(GDALPaletteInterp const& paletteInterp,
 */
 int gdal2opencv(const GDALDataType& gdalType, const int& channels);
 
-class MapLayer : public QWidget
+/**
+* Write one pixel value, range cast to the image depth, into a channel of
+* the image; the per pixel path for bands without a row converter
+*/
+void write_pixel(const double& pixelValue,
+	const GDALDataType& gdalType,
+	const int& gdalChannels,
+	Mat& image,
+	const int& row,
+	const int& col,
+	const int& channel);
+
+/**
+* Write one row of a band into its channel of an interleaved image row
+*/
+typedef void(*RowConverter)(const void*, void*, const int&, const int&, const int&);
+
+/**
+* Pick the row converter for a GDAL type, OpenCV depth and channel layout.
+* Returns NULL for pairs that still need write_pixel.
+*/
+RowConverter select_row_converter(const GDALDataType& gdalType,
+	const int& cvDepth,
+	const int& channels);
+
+class MapLayer : public QObject
 {
 	Q_OBJECT
 public:
@@ -61,25 +97,62 @@ public:
 	QList<GDALRasterBand *> m_bands;/// GDAL Band 
 	QList<double> m_min;
 	QList<double> m_max;
+	QList<BandStatistics> m_stats;
+	QList<BandStatistics> m_exactStats;/// Handed over by the background pass
+	QMutex m_statsMutex;/// Guards m_exactStats
+	std::thread m_statsThread;/// Exact statistics pass over a layer opened with estimates
+	std::atomic<bool> m_statsCancel;/// Aborts m_statsThread
 	QList<QPair<int, int>> m_block;
 	QList<GDALDataType> m_gdType;
 	QList<GDALColorInterp> m_colorInterp;
 	int m_cvType;
+	Mat m_paletteLut;/// Color table expanded to one entry per index
+	CPLVirtualMem *m_virtualMem;/// File mapping m_image points into, if any
+	std::atomic<bool> m_cancel;/// Set by cancel() to abort readData
+	std::function<void(int)> m_progress;/// Called with the rows read so far, from reader threads
 
 	Mat m_image;
 	QImage m_imageDraw;
+	Mat m_display;/// Decimated image shown for lazy layers
+
+	bool m_lazy;/// Fetch pixels on demand through the tile cache instead of m_image
+	int m_tileSize;
+	QMutex m_ioMutex;/// Serializes reads on m_dataset
+	int m_ioThreads;/// Workers used by readData, each with its own dataset handle
+
+	QString m_lastError;/// Reason the last operation failed
 
 	QStandardItemModel *imgMetaModel;
 	QList<QStandardItem *> prepareRow(const QString &first, const QString &second);
 	
 	void initMatData();
+	bool mapData();
 	bool readHeader();
 	bool readData();
+	void cancel();
+	bool readRegion(const cv::Rect& roi, Mat& image);
+	bool readRegion(GDALDataset* dataset, const cv::Rect& roi, Mat& image);
+	bool bandChannels(GDALDataset* dataset, QList<int>& colors);
+	void buildPaletteLut();
+
+	// tile and window access, valid for both resident and lazy layers
+	void setLazy(bool lazy);
+	bool isLazy() const;
+	Mat readTile(const int& tx, const int& ty);
+	Mat window(const cv::Rect& roi);
+	Mat overview(const cv::Size& size);
 	void setMetaModel();
+	void computeStatistics();
+	void waitForStatistics();
 	//bool getQImage();
 	QImage getQImage();
+	QImage toDisplayImage(const Mat& image) const;
 	QImage cvt16bTo8b(cv::Mat &src);
-	
 
+signals:
+	void statisticsChanged();
+
+private slots:
+	void applyStatistics();
 };
 
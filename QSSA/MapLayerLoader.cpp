@@ -0,0 +1,63 @@
+#include "MapLayerLoader.h"
+
+MapLayerLoader::MapLayerLoader(MapLayer *layer)
+{
+	m_layer = layer;
+	m_canceled = false;
+	m_displayScale = 1.0;
+
+	// the loader is deleted by whoever handles finished()
+	setAutoDelete(false);
+}
+
+MapLayerLoader::~MapLayerLoader()
+{
+}
+
+void MapLayerLoader::run()
+{
+	// report the rows read by the (possibly parallel) reader as a percentage
+	m_layer->m_progress = [this](int rows) {
+		emit progress(rows * 100 / std::max(1, m_layer->m_height));
+	};
+
+	bool ok = !m_canceled && m_layer->readHeader();
+
+	// show the coarsest overview right away, then finer ones while they add
+	// detail at the current zoom
+	if (ok && !m_canceled)
+	{
+		GDALRasterBand *band = m_layer->m_dataset->GetRasterBand(1);
+		const double neededWidth = m_layer->m_width * std::min(1.0, m_displayScale);
+		for (int level = band->GetOverviewCount() - 1; level >= 0 && !m_canceled; --level)
+		{
+			GDALRasterBand *overview = band->GetOverview(level);
+			if (overview == NULL) { continue; }
+
+			const cv::Size size(overview->GetXSize(), overview->GetYSize());
+			emit previewReady(m_layer->toDisplayImage(m_layer->overview(size)));
+
+			if (size.width >= neededWidth) { break; }
+		}
+	}
+
+	if (ok && !m_canceled)
+	{
+		m_layer->initMatData();
+		ok = m_layer->readData();
+	}
+
+	m_layer->m_progress = nullptr;
+	emit finished(ok && !m_canceled);
+}
+
+void MapLayerLoader::cancel()
+{
+	m_canceled = true;
+	m_layer->cancel();
+}
+
+bool MapLayerLoader::isCanceled() const
+{
+	return m_canceled;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// User Headers
+#include "MapLayer.h"
+
+/**
+* Loads a MapLayer on a worker thread of QThreadPool. The header and the
+* pixel data are read off the GUI thread; the layer is handed back through
+* finished() and must only be registered and shown from there.
+*/
+class MapLayerLoader : public QObject, public QRunnable
+{
+	Q_OBJECT
+public:
+	MapLayerLoader(MapLayer *layer);
+	~MapLayerLoader();
+
+	MapLayer *m_layer;
+
+	double m_displayScale;/// Viewer scale, bounds the overview detail worth loading
+
+	void run() override;
+	void cancel();
+	bool isCanceled() const;
+
+signals:
+	void progress(int percent);
+	void previewReady(QImage image);
+	void finished(bool ok);
+
+private:
+	std::atomic<bool> m_canceled;
+};
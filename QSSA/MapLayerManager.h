@@ -1,5 +1,7 @@
 #pragma once
 
+#include <QtWidgets>
+
 #include "MapLayer.h"
 
 class MapLayerManager : public QWidget
@@ -138,6 +138,10 @@ MapViewer::MapViewer(QWidget *parent)
 	connect(zoomSlider, SIGNAL(valueChanged(int)), this, SLOT(setupMatrix()));
 	connect(rotateSlider, SIGNAL(valueChanged(int)), this, SLOT(setupMatrix()));
 
+	// panning moves the hidden scroll bars
+	connect(graphicsView->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SIGNAL(viewChanged()));
+	connect(graphicsView->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SIGNAL(viewChanged()));
+
 	setupMatrix();
 }
 
@@ -146,6 +150,11 @@ QGraphicsView *MapViewer::view() const
 	return static_cast<QGraphicsView *>(graphicsView);
 }
 
+qreal MapViewer::scale() const
+{
+	return qPow(qreal(2), (zoomSlider->value() - 250) / qreal(50));
+}
+
 void MapViewer::mouseDoubleClickEvent(QMouseEvent * event)
 {
 	Q_UNUSED(event);
@@ -194,7 +203,7 @@ void MapViewer::setupMatrix()
 	matrix.rotate(rotateSlider->value());
 
 	graphicsView->setMatrix(matrix);
-
+	emit viewChanged();
 }
 
 void MapViewer::print()
@@ -30,6 +30,7 @@ public:
 	explicit MapViewer(QWidget *parent = 0);
 
 	QGraphicsView *view() const;
+	qreal scale() const;
 
 protected:
 	void mouseDoubleClickEvent(QMouseEvent *event);
@@ -51,6 +52,7 @@ private:
 	QSlider *rotateSlider;
 signals:
 	void xyCoordinates(const QPoint &p);
+	void viewChanged();
 };
 
 #endif // MAPVIEWER_H
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::s_alive(false);
+
+Profiler::Profiler()
+{
+	m_origin = std::chrono::steady_clock::now();
+	m_buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer));
+	m_buffers.front()->thread = 0;
+	m_eventCount = 0;
+	m_dropped = 0;
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		m_counters[i] = 0;
+	}
+	s_alive = true;
+}
+
+Profiler::~Profiler()
+{
+	s_alive = false;
+}
+
+Profiler *Profiler::instance()
+{
+	static Profiler profiler;
+	return &profiler;
+}
+
+qint64 Profiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_origin).count();
+}
+
+/*
+* The calling thread's buffer, registered on its first record and retired
+* when the thread exits
+*/
+Profiler::ThreadBuffer *Profiler::threadBuffer()
+{
+	static thread_local BufferOwner owner;
+	if (owner.buffer == nullptr) {
+		owner.buffer = new ThreadBuffer;
+		owner.buffer->thread = (quint64)(quintptr)QThread::currentThreadId();
+		QMutexLocker locker(&m_mutex);
+		m_buffers.push_back(std::unique_ptr<ThreadBuffer>(owner.buffer));
+	}
+	return owner.buffer;
+}
+
+Profiler::BufferOwner::~BufferOwner()
+{
+	// past the profiler's lifetime the buffer went with it
+	if (buffer != nullptr && s_alive) {
+		Profiler::instance()->retire(buffer);
+	}
+}
+
+/*
+* Move an exiting thread's events and tallies into the shared buffer and
+* free its own. Events keep the id of the thread that recorded them.
+*/
+void Profiler::retire(ThreadBuffer *buffer)
+{
+	QMutexLocker locker(&m_mutex);
+	ThreadBuffer *retired = m_buffers.front().get();
+	for (size_t b = 1; b < m_buffers.size(); b++) {
+		if (m_buffers[b].get() != buffer) { continue; }
+		{
+			QMutexLocker retiredLocker(&retired->mutex);
+			QMutexLocker bufferLocker(&buffer->mutex);
+			retired->events.insert(retired->events.end(), buffer->events.begin(), buffer->events.end());
+			for (QHash<const char *, Tally>::const_iterator it = buffer->stages.constBegin(); it != buffer->stages.constEnd(); ++it) {
+				QHash<const char *, Tally>::iterator tally = retired->stages.find(it.key());
+				if (tally == retired->stages.end()) {
+					retired->stages.insert(it.key(), *it);
+					continue;
+				}
+				tally->calls += it->calls;
+				tally->total += it->total;
+				tally->max = std::max(tally->max, it->max);
+			}
+		}
+		m_buffers.erase(m_buffers.begin() + b);
+		return;
+	}
+}
+
+void Profiler::record(const char *name, const char *category, const qint64& start, const qint64& duration)
+{
+	ThreadBuffer *buffer = threadBuffer();
+	QMutexLocker locker(&buffer->mutex);
+	if (m_eventCount.fetch_add(1, std::memory_order_relaxed) < MAX_EVENTS) {
+		const Event event = { name, category, start, duration, buffer->thread };
+		buffer->events.push_back(event);
+	}
+	else {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// fold into the summary, whether the event was kept or not
+	QHash<const char *, Tally>::iterator it = buffer->stages.find(name);
+	if (it == buffer->stages.end()) {
+		const Tally tally = { category, 0, 0, 0 };
+		it = buffer->stages.insert(name, tally);
+	}
+	it->calls++;
+	it->total += duration;
+	it->max = std::max(it->max, duration);
+}
+
+void Profiler::add(const Counter& counter, const qint64& value)
+{
+	m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+qint64 Profiler::counter(const Counter& counter) const
+{
+	return m_counters[counter].load(std::memory_order_relaxed);
+}
+
+const char *Profiler::counterName(const Counter& counter)
+{
+	switch (counter) {
+	case PIXELS_SAMPLED: return "Pixels sampled";
+	case OUT_OF_BOUNDS_SAMPLES: return "Out-of-bounds samples";
+	case BYTES_READ: return "Bytes read";
+	case CACHE_HITS: return "Tile cache hits";
+	case CACHE_MISSES: return "Tile cache misses";
+	default: return "";
+	}
+}
+
+QList<Profiler::Stage> Profiler::stages() const
+{
+	// the same name can come from several threads and translation units
+	QHash<QString, Stage> merged;
+	{
+		QMutexLocker locker(&m_mutex);
+		for (size_t b = 0; b < m_buffers.size(); b++) {
+			ThreadBuffer *buffer = m_buffers[b].get();
+			QMutexLocker bufferLocker(&buffer->mutex);
+			for (QHash<const char *, Tally>::const_iterator it = buffer->stages.constBegin(); it != buffer->stages.constEnd(); ++it) {
+				Stage& stage = merged[QLatin1String(it.key())];
+				if (stage.calls == 0) {
+					stage.name = QLatin1String(it.key());
+					stage.category = QLatin1String(it->category);
+				}
+				stage.calls += it->calls;
+				stage.total += it->total;
+				stage.max = std::max(stage.max, it->max);
+			}
+		}
+	}
+
+	QList<Stage> stages = merged.values();
+	std::sort(stages.begin(), stages.end(), [](const Stage& a, const Stage& b) { return a.total > b.total; });
+	return stages;
+}
+
+qint64 Profiler::droppedEvents() const
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+/*
+* Complete ("X") events per scope and one counter ("C") event per counter,
+* in the trace event format read by chrome://tracing and Perfetto
+*/
+bool Profiler::writeChromeTrace(const QString& fileName) const
+{
+	QJsonArray trace;
+	const qint64 pid = QCoreApplication::applicationPid();
+	qint64 end = 0;
+	{
+		QMutexLocker locker(&m_mutex);
+		for (size_t b = 0; b < m_buffers.size(); b++) {
+			ThreadBuffer *buffer = m_buffers[b].get();
+			QMutexLocker bufferLocker(&buffer->mutex);
+			for (size_t i = 0; i < buffer->events.size(); i++) {
+				const Event& event = buffer->events[i];
+				QJsonObject entry;
+				entry["name"] = QLatin1String(event.name);
+				entry["cat"] = QLatin1String(event.category);
+				entry["ph"] = QString("X");
+				entry["ts"] = event.start;
+				entry["dur"] = event.duration;
+				entry["pid"] = pid;
+				entry["tid"] = (double)event.thread;
+				trace.append(entry);
+				end = std::max(end, event.start + event.duration);
+			}
+		}
+	}
+
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		QJsonObject args;
+		args["value"] = (double)counter((Counter)i);
+		QJsonObject entry;
+		entry["name"] = QLatin1String(counterName((Counter)i));
+		entry["ph"] = QString("C");
+		entry["ts"] = end;
+		entry["pid"] = pid;
+		entry["args"] = args;
+		trace.append(entry);
+	}
+
+	// scopes past the event budget are in the stages but not the trace
+	QJsonObject otherData;
+	otherData["dropped_events"] = (double)droppedEvents();
+	otherData["max_events"] = MAX_EVENTS;
+
+	QJsonObject document;
+	document["traceEvents"] = trace;
+	document["displayTimeUnit"] = QString("ms");
+	document["otherData"] = otherData;
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	return file.write(QJsonDocument(document).toJson(QJsonDocument::Compact)) > 0;
+}
+
+void Profiler::reset()
+{
+	QMutexLocker locker(&m_mutex);
+	for (size_t b = 0; b < m_buffers.size(); b++) {
+		ThreadBuffer *buffer = m_buffers[b].get();
+		QMutexLocker bufferLocker(&buffer->mutex);
+		buffer->events.clear();
+		buffer->stages.clear();
+	}
+	m_eventCount = 0;
+	m_dropped = 0;
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		m_counters[i] = 0;
+	}
+}
+
+ScopedTimer::ScopedTimer(const char *name, const char *category)
+{
+	m_name = name;
+	m_category = category;
+	m_start = Profiler::instance()->now();
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	Profiler *profiler = Profiler::instance();
+	profiler->record(m_name, m_category, m_start, profiler->now() - m_start);
+}
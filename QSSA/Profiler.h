@@ -0,0 +1,125 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+/**
+* Process wide, thread-safe collector of scoped stage timings and hot path
+* counters. Every finished scope is kept as a trace event (up to a fixed
+* budget) and folded into a per-stage summary, so slow runs can be broken
+* down into I/O, sampling and encoding and exported as a Chrome trace.
+*
+* Each thread records into a buffer of its own, keyed by the name pointer,
+* so recording takes no shared lock and hashes no strings; the buffers are
+* merged by name when the stages or the trace are read. A thread's buffer is
+* folded into a shared one when the thread exits, so worker pools that come
+* and go do not pile up buffers.
+*/
+class Profiler
+{
+public:
+	enum Counter
+	{
+		PIXELS_SAMPLED = 0,
+		OUT_OF_BOUNDS_SAMPLES = 1,
+		BYTES_READ = 2,
+		CACHE_HITS = 3,
+		CACHE_MISSES = 4,
+		COUNTER_COUNT = 5
+	};
+
+	struct Event
+	{
+		const char *name;
+		const char *category;
+		qint64 start;/// Microseconds since the profiler was created
+		qint64 duration;
+		quint64 thread;
+	};
+
+	struct Stage
+	{
+		QString name;
+		QString category;
+		qint64 calls = 0;
+		qint64 total = 0;/// Microseconds
+		qint64 max = 0;
+	};
+
+	static const int MAX_EVENTS = 1 << 18;
+
+	static Profiler *instance();
+
+	qint64 now() const;
+	void record(const char *name, const char *category, const qint64& start, const qint64& duration);
+	void add(const Counter& counter, const qint64& value = 1);
+
+	qint64 counter(const Counter& counter) const;
+	static const char *counterName(const Counter& counter);
+	QList<Stage> stages() const;
+	qint64 droppedEvents() const;
+
+	bool writeChromeTrace(const QString& fileName) const;
+	void reset();
+
+private:
+	Profiler();/// One process wide instance, the thread buffers belong to it
+	~Profiler();
+
+	struct Tally
+	{
+		const char *category;
+		qint64 calls;
+		qint64 total;
+		qint64 max;
+	};
+
+	struct ThreadBuffer
+	{
+		QMutex mutex;/// Only contended while the buffers are read or reset
+		quint64 thread;
+		std::vector<Event> events;
+		QHash<const char *, Tally> stages;
+	};
+
+	// retires the calling thread's buffer when the thread exits
+	struct BufferOwner
+	{
+		ThreadBuffer *buffer = nullptr;
+		~BufferOwner();
+	};
+
+	ThreadBuffer *threadBuffer();
+	void retire(ThreadBuffer *buffer);
+
+	static std::atomic<bool> s_alive;/// Threads may exit after the profiler is destroyed
+	std::chrono::steady_clock::time_point m_origin;
+	std::vector<std::unique_ptr<ThreadBuffer> > m_buffers;/// The first one holds what exited threads recorded
+	std::atomic<qint64> m_eventCount;
+	std::atomic<qint64> m_dropped;
+	std::atomic<qint64> m_counters[COUNTER_COUNT];
+	mutable QMutex m_mutex;/// Guards m_buffers
+};
+
+/**
+* Times the enclosing scope into the profiler. Names and categories have to
+* be string literals, they are kept by pointer.
+*/
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(const char *name, const char *category = "qssa");
+	~ScopedTimer();
+
+private:
+	const char *m_name;
+	const char *m_category;
+	qint64 m_start;
+};
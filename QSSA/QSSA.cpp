@@ -27,50 +27,165 @@ QSSA::QSSA(QWidget *parent)
 
 	connect(demList, SIGNAL(currentIndexChanged(int)), this, SLOT(setDEM()));
 	connect(landsatList, SIGNAL(currentIndexChanged(int)), this, SLOT(setLandsat()));
+	connect(waterList, SIGNAL(currentIndexChanged(int)), this, SLOT(setWater()));
 	connect(matchList, SIGNAL(currentIndexChanged(int)), this, SLOT(setMatchMethod()));
 	connect(submergeList, SIGNAL(currentIndexChanged(int)), this, SLOT(setSubMethod()));
+	connect(resampleList, SIGNAL(currentIndexChanged(int)), this, SLOT(setResampling()));
 
 	connect(submergePushBtn, &QPushButton::clicked, this, &QSSA::runSubmerge);
 	connect(submerge, &Submerge::submergeProgress, this, &QSSA::runProgress);
 	connect(submerge, &Submerge::submergeFinish, this, &QSSA::runFinish);
+	connect(submerge, &Submerge::submergeError, this, &QSSA::runError);
+
+	connect(overlayCheck, &QCheckBox::toggled, this, &QSSA::toggleFloodOverlay);
+	connect(seaLevelSlider, &QSlider::valueChanged, this, &QSSA::updateFloodOverlay);
+	connect(viewer, &MapViewer::viewChanged, this, &QSSA::updateFloodOverlay);
 }
 
 QSSA::~QSSA()
 {
-
+	// stop the loaders still running; they and their layers are not
+	// handed over by loadFinished any more
+	cancelLoading();
+	QThreadPool::globalInstance()->waitForDone();
+	foreach(MapLayerLoader *loader, loaders.keys())
+	{
+		delete loader->m_layer;
+		delete loader;
+	}
+	loaders.clear();
 }
 
 bool QSSA::loadFile(const QString &fileName)
 {
-	statusBar()->showMessage(tr("Loading dataset, please waiting ..."));
-	MapLayer *layer = new MapLayer(fileName);
-	if (layer->readHeader())
+	// refuse files that are open or still loading
+	if (layerManager->allLayers.contains(fileName) || loadingFiles().contains(fileName))
 	{
-		layer->setMetaModel();
-		layer->initMatData();
-		layer->readData();
+		QMessageBox::critical(this, tr("Error!"), tr("File %1 Already opened").arg(fileName));
+		return false;
+	}
 
-		// add layer to layer manager
-		if (!layerManager->addLayer(layer)) 
-		{
-			QMessageBox::critical(this, tr("Error!"), tr("File %1 Already opened").arg(fileName));
-			return false;
-		}
+	MapLayer *layer = new MapLayer(fileName);
+	layer->setLazy(lazyLoadAct->isChecked());
+	layer->m_ioThreads = readerThreads;
+
+	// read the file on the thread pool, the layer is registered once it is done
+	MapLayerLoader *loader = new MapLayerLoader(layer);
+	loader->m_displayScale = viewer->scale();
+	connect(loader, &MapLayerLoader::progress, this, &QSSA::loadProgress);
+	connect(loader, &MapLayerLoader::previewReady, this, &QSSA::loadPreview);
+	connect(loader, &MapLayerLoader::finished, this, &QSSA::loadFinished);
+	loaders.insert(loader, 0);
+	updateLoadStatus();
+
+	QThreadPool::globalInstance()->start(loader);
+	return true;
+}
 
-		// update processing dock window
-		//QFileInfo fi(fileName);
-		demList->addItem(fileName);
-		landsatList->addItem(fileName);
+QStringList QSSA::loadingFiles() const
+{
+	QStringList files;
+	foreach(MapLayerLoader *loader, loaders.keys())
+		files << loader->m_layer->m_filename;
+	return files;
+}
 
-		layerManager->updateLayerModel();//ӦupdateLayerӦ飬ȷŵ
-		emit layerManager->layerChanged();
-		return true;
+void QSSA::loadProgress(int percent)
+{
+	MapLayerLoader *loader = qobject_cast<MapLayerLoader *>(sender());
+	if (loader == nullptr || !loaders.contains(loader)) { return; }
+
+	loaders[loader] = percent;
+	updateLoadStatus();
+}
+
+void QSSA::loadPreview(QImage image)
+{
+	MapLayerLoader *loader = qobject_cast<MapLayerLoader *>(sender());
+	if (loader == nullptr || !loaders.contains(loader) || image.isNull()) { return; }
+
+	// previews only stand in for an empty view, never for the current layer
+	if (!layerManager->allLayers.isEmpty()) { return; }
+
+	// draw the overview in full resolution scene coordinates until the
+	// layer itself is ready
+	scene->clear();
+	floodItem = nullptr;
+	pixmapItem = new QGraphicsPixmapItem(QPixmap::fromImage(image));
+	pixmapItem->setScale((qreal)loader->m_layer->m_width / image.width());
+	pixmapItem->setTransformationMode(Qt::SmoothTransformation);
+	scene->addItem(pixmapItem);
+}
+
+void QSSA::loadFinished(bool ok)
+{
+	MapLayerLoader *loader = qobject_cast<MapLayerLoader *>(sender());
+	if (loader == nullptr || !loaders.contains(loader)) { return; }
+
+	loaders.remove(loader);
+	loader->deleteLater();
+	updateLoadStatus();
+
+	MapLayer *layer = loader->m_layer;
+	const QString fileName = layer->m_filename;
+
+	if (loader->isCanceled())
+	{
+		delete layer;
+		statusBar()->showMessage(tr("Canceled loading %1").arg(fileName));
+		return;
 	}
-	else
+
+	if (!ok)
 	{
+		delete layer;
 		QMessageBox::critical(this, tr("Error!"), tr("Can not open file %1").arg(fileName));
-		return false;
+		return;
 	}
+
+	// the metadata model lives on the GUI thread
+	layer->setMetaModel();
+	connect(layer, &MapLayer::statisticsChanged, infoTree, &QTreeView::expandAll);
+
+	// add layer to layer manager
+	if (!layerManager->addLayer(layer))
+	{
+		delete layer;
+		QMessageBox::critical(this, tr("Error!"), tr("File %1 Already opened").arg(fileName));
+		return;
+	}
+
+	// update processing dock window
+	//QFileInfo fi(fileName);
+	demList->addItem(fileName);
+	landsatList->addItem(fileName);
+	waterList->addItem(fileName);
+
+	layerManager->updateLayerModel();//ӦupdateLayerӦ飬ȷŵ
+	emit layerManager->layerChanged();
+	statusBar()->showMessage(tr("Loaded %1").arg(fileName));
+}
+
+void QSSA::cancelLoading()
+{
+	foreach(MapLayerLoader *loader, loaders.keys())
+		loader->cancel();
+}
+
+void QSSA::updateLoadStatus()
+{
+	const bool loading = !loaders.isEmpty();
+	loadProgressBar->setVisible(loading);
+	cancelLoadBtn->setVisible(loading);
+	cancelLoadAct->setEnabled(loading);
+	if (!loading) { return; }
+
+	// show the average progress of all files being loaded
+	int total = 0;
+	foreach(int percent, loaders.values())
+		total += percent;
+	loadProgressBar->setValue(total / loaders.size());
+	statusBar()->showMessage(tr("Loading %1 dataset(s), please waiting ...").arg(loaders.size()));
 }
 
 void QSSA::setupCenter()
@@ -94,6 +209,9 @@ void QSSA::setupMenuBar()
 	QAction *openAct = fileMenu->addAction(tr("&Open..."), this, &QSSA::open);
 	openAct->setShortcut(QKeySequence::Open);
 
+	cancelLoadAct = fileMenu->addAction(tr("&Cancel Loading"), this, &QSSA::cancelLoading);
+	cancelLoadAct->setEnabled(false);
+
 	saveAsAct = fileMenu->addAction(tr("&Save As..."), this, &QSSA::saveAs);
 	saveAsAct->setEnabled(false);
 
@@ -158,6 +276,25 @@ void QSSA::setupMenuBar()
 	/// Settings
 	QMenu *settingMenu = menuBar()->addMenu(tr("&Settings"));
 
+	lazyLoadAct = settingMenu->addAction(tr("&Lazy Tiled Loading"));
+	lazyLoadAct->setCheckable(true);
+	lazyLoadAct->setChecked(false);
+
+	settingMenu->addAction(tr("&Tile Cache Size..."), this, &QSSA::setTileCacheSize);
+	settingMenu->addAction(tr("&Reader Threads..."), this, &QSSA::setReaderThreads);
+	settingMenu->addAction(tr("Transform To&lerance..."), this, &QSSA::setTransformTolerance);
+	settingMenu->addAction(tr("&Flood Levels..."), this, &QSSA::setFloodLevels);
+
+	settingMenu->addSeparator();
+
+	eightConnectedAct = settingMenu->addAction(tr("&8-Connected Flooding"));
+	eightConnectedAct->setCheckable(true);
+	eightConnectedAct->setChecked(true);
+
+	streamingAct = settingMenu->addAction(tr("&Streaming Tiled Output"));
+	streamingAct->setCheckable(true);
+	streamingAct->setChecked(false);
+
 	/// Processing
 	QMenu *processMenu = menuBar()->addMenu(tr("&Processing"));
 
@@ -190,6 +327,18 @@ void QSSA::setupConnections()
 void QSSA::setupStatusBar()
 {
 	statusBar()->showMessage(tr("Welcome to QSystem of Submerging Analysis"));
+
+	// progress of background file loading
+	loadProgressBar = new QProgressBar;
+	loadProgressBar->setRange(0, 100);
+	loadProgressBar->setMaximumWidth(200);
+	loadProgressBar->setVisible(false);
+	statusBar()->addPermanentWidget(loadProgressBar);
+
+	cancelLoadBtn = new QToolButton;
+	cancelLoadBtn->setDefaultAction(cancelLoadAct);
+	cancelLoadBtn->setVisible(false);
+	statusBar()->addPermanentWidget(cancelLoadBtn);
 }
 
 void QSSA::setupDockBrowserWindow()
@@ -313,11 +462,16 @@ void QSSA::setupDockProcessWindow()
 	landsatList = new QComboBox(submergeGroupBox);
 	landsatList->setEnabled(false);
 
+	// the first entry seeds active submerging from the DEM edges
+	waterList = new QComboBox(submergeGroupBox);
+	waterList->addItem(tr("None"));
+	waterList->setEnabled(false);
+
 	matchList = new QComboBox(submergeGroupBox);
 	matchList->addItem(QStringLiteral("Based GEOGCS"));
 	matchList->addItem(QStringLiteral("Based PROJCS"));
 	matchList->addItem(QStringLiteral("Based SIFT"));
-	matchList->addItem(QStringLiteral("Based SURF"));
+	matchList->addItem(QStringLiteral("Based ORB"));
 	matchList->setEnabled(false);
 
 	submergeList = new QComboBox(submergeGroupBox);
@@ -325,9 +479,25 @@ void QSSA::setupDockProcessWindow()
 	submergeList->addItem(QStringLiteral("Active Submerging"));
 	submergeList->setEnabled(false);
 
+	resampleList = new QComboBox(submergeGroupBox);
+	resampleList->addItem(QStringLiteral("Nearest"));
+	resampleList->addItem(QStringLiteral("Bilinear"));
+	resampleList->addItem(QStringLiteral("Bicubic"));
+	resampleList->setEnabled(false);
+
 	submergePushBtn = new QPushButton(submergeGroupBox);
 	submergePushBtn->setEnabled(false);
 	submergePushBtn->setText(QStringLiteral("Submerging"));
+
+	overlayCheck = new QCheckBox(submergeGroupBox);
+	overlayCheck->setText(QStringLiteral("Live Flood Overlay"));
+
+	seaLevelSlider = new QSlider(Qt::Horizontal, submergeGroupBox);
+	seaLevelSlider->setRange(-200, 2000);/// decimetres
+	seaLevelSlider->setValue(100);
+	seaLevelSlider->setEnabled(false);
+
+	seaLevelLabel = new QLabel(QStringLiteral("Sea Level: 10.0 m"), submergeGroupBox);
 	// Construct panel
 	GDALLayout->addWidget(new QLabel(QStringLiteral("DEM")));
 	GDALLayout->addWidget(hillshadePushBtn, 0, Qt::AlignTop);
@@ -371,12 +541,19 @@ void QSSA::setupDockProcessWindow()
 	submergeLayout->addWidget(demList);
 	submergeLayout->addWidget(new QLabel(QStringLiteral("Landsat File")));
 	submergeLayout->addWidget(landsatList);
+	submergeLayout->addWidget(new QLabel(QStringLiteral("Water Mask File")));
+	submergeLayout->addWidget(waterList);
 	submergeLayout->addWidget(new QLabel(QStringLiteral("Match Method")));
 	submergeLayout->addWidget(matchList);
 	submergeLayout->addWidget(new QLabel(QStringLiteral("Submerging Method")));
 	submergeLayout->addWidget(submergeList);
+	submergeLayout->addWidget(new QLabel(QStringLiteral("DEM Resampling")));
+	submergeLayout->addWidget(resampleList);
 	submergeLayout->addWidget(new QLabel(QStringLiteral("Run Analysis")));
 	submergeLayout->addWidget(submergePushBtn);
+	submergeLayout->addWidget(overlayCheck);
+	submergeLayout->addWidget(seaLevelLabel);
+	submergeLayout->addWidget(seaLevelSlider);
 	submergeLayout->addStretch();
 
 	// Combine various processing panels to a ToolBox
@@ -389,16 +566,64 @@ void QSSA::setupDockProcessWindow()
 	addDockWidget(Qt::RightDockWidgetArea, dockImgProcessWindow);
 }
 
+void QSSA::setupDockProfilerWindow()
+{
+	/* Setup profiler dock window */
+	dockProfilerWindow = new QDockWidget(tr("Profiler"), this);
+	dockProfilerWindow->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+
+	QWidget *profilerWidget = new QWidget(dockProfilerWindow);
+	profilerTree = new QTreeWidget(profilerWidget);
+	profilerTree->setHeaderLabels(QStringList() << tr("Stage") << tr("Calls") << tr("Total (ms)") << tr("Mean (ms)") << tr("Max (ms)"));
+	profilerTree->setRootIsDecorated(false);
+
+	QPushButton *refreshPushBtn = new QPushButton(tr("Refresh"));
+	QPushButton *resetPushBtn = new QPushButton(tr("Reset"));
+	QPushButton *exportPushBtn = new QPushButton(tr("Export Trace..."));
+	QHBoxLayout *buttonLayout = new QHBoxLayout;
+	buttonLayout->addWidget(refreshPushBtn);
+	buttonLayout->addWidget(resetPushBtn);
+	buttonLayout->addWidget(exportPushBtn);
+
+	QVBoxLayout *profilerLayout = new QVBoxLayout(profilerWidget);
+	profilerLayout->addWidget(profilerTree);
+	profilerLayout->addLayout(buttonLayout);
+
+	dockProfilerWindow->setWidget(profilerWidget);
+	addDockWidget(Qt::RightDockWidgetArea, dockProfilerWindow);
+
+	// keep the numbers current while the panel is shown
+	profilerTimer = new QTimer(this);
+	profilerTimer->setInterval(1000);
+	connect(profilerTimer, &QTimer::timeout, this, &QSSA::refreshProfiler);
+	connect(dockProfilerWindow, &QDockWidget::visibilityChanged, [this](bool visible) {
+		if (visible) {
+			refreshProfiler();
+			profilerTimer->start();
+		}
+		else {
+			profilerTimer->stop();
+		}
+	});
+
+	connect(refreshPushBtn, &QPushButton::clicked, this, &QSSA::refreshProfiler);
+	connect(resetPushBtn, &QPushButton::clicked, this, &QSSA::resetProfiler);
+	connect(exportPushBtn, &QPushButton::clicked, this, &QSSA::exportTrace);
+}
+
 void QSSA::setupDockWindows()
 {
 	setupDockBrowserWindow();
 	setupDockLayerWindow();
 	setupDockInfoWindow();
 	setupDockProcessWindow();
+	setupDockProfilerWindow();
 
 	/* Set layout*/
 	tabifyDockWidget(dockImgLayerWindow, dockImgInfoWindow);
 	dockImgLayerWindow->raise();
+	tabifyDockWidget(dockImgProcessWindow, dockProfilerWindow);
+	dockImgProcessWindow->raise();
 }
 
 void QSSA::updateLayer()
@@ -417,7 +642,26 @@ void QSSA::updateLayer()
 
 		// update central display window --> setImage()
 		scene->clear();
-		pixmapItem = new QGraphicsPixmapItem(QPixmap::fromImage(layerManager->getCurLayer()->getQImage()));
+		floodItem = nullptr;
+		MapLayer *layer = layerManager->getCurLayer();
+		QImage image;
+		{
+			ScopedTimer timer("MapLayer::getQImage", "display");
+			image = layer->getQImage();
+		}
+		if (image.isNull() && !layer->m_lastError.isEmpty()) {
+			QMessageBox::information(this, tr("Note!"), layer->m_lastError);
+		}
+		QPixmap pixmap;
+		{
+			ScopedTimer timer("QPixmap::fromImage", "display");
+			pixmap = QPixmap::fromImage(image);
+		}
+		pixmapItem = new QGraphicsPixmapItem(pixmap);
+		// lazy layers draw a decimated image, keep the scene in full resolution pixels
+		if (!image.isNull() && image.width() != layer->m_width) {
+			pixmapItem->setScale((qreal)layer->m_width / image.width());
+		}
 		//pixmapItem->setFlags(QGraphicsPixmapItem::ItemIsSelectable | QGraphicsPixmapItem::ItemIsMovable);
 		pixmapItem->setAcceptHoverEvents(true);
 		scene->addItem(pixmapItem);
@@ -437,8 +681,10 @@ void QSSA::updateLayer()
 	submergePushBtn->setEnabled(has_layer);
 	demList->setEnabled(has_layer);
 	landsatList->setEnabled(has_layer);
+	waterList->setEnabled(has_layer);
 	matchList->setEnabled(has_layer);
 	submergeList->setEnabled(has_layer);
+	resampleList->setEnabled(has_layer);
 
 	/// update actions
 	saveAsAct->setEnabled(layerManager->getCurLayer());
@@ -449,6 +695,10 @@ void QSSA::updateLayer()
 	rotateLeftAct->setEnabled(has_layer);
 	rotateRightAct->setEnabled(has_layer);
 
+	// the scene was rebuilt, put the flood overlay back on top
+	if (has_layer) {
+		updateFloodOverlay();
+	}
 }
 
 void QSSA::selectionChangedSlot(const QItemSelection & newSelection, const QItemSelection & oldSelection)
@@ -494,6 +744,17 @@ void QSSA::setLandsat()
 		.arg(landsatLayer));*/
 }
 
+void QSSA::setWater()
+{
+	if (waterList->currentIndex() <= 0) {
+		submerge->m_water = nullptr;
+		statusBar()->showMessage(tr("Seed active submerging from the DEM edges."));
+		return;
+	}
+	submerge->m_water = layerManager->allLayers.value(waterList->currentText());
+	statusBar()->showMessage(tr("Set water mask file to %1").arg(waterList->currentText()));
+}
+
 void QSSA::setMatchMethod()
 {
 	int method = matchList->currentIndex();
@@ -512,8 +773,8 @@ void QSSA::setMatchMethod()
 		statusBar()->showMessage(tr("Set submerge match method to 'SIFT feature detector'."));
 		break;
 	case 3:
-		submerge->m_matchMethod = Submerge::BASE_SURF;
-		statusBar()->showMessage(tr("Set submerge match method to 'SURF feature detector'."));
+		submerge->m_matchMethod = Submerge::BASE_ORB;
+		statusBar()->showMessage(tr("Set submerge match method to 'ORB feature detector'."));
 		break;
 	default:
 		submerge->m_matchMethod = Submerge::BASE_GEOGCS;
@@ -548,8 +809,106 @@ void QSSA::setSubMethod()
 	.arg(submergeMethod));*/
 }
 
+void QSSA::setResampling()
+{
+	int method = resampleList->currentIndex();
+	switch (method)
+	{
+	case 1:
+		submerge->m_resampling = Submerge::BILINEAR_SAMPLING;
+		statusBar()->showMessage(tr("Set DEM resampling to 'Bilinear'."));
+		break;
+	case 2:
+		submerge->m_resampling = Submerge::BICUBIC_SAMPLING;
+		statusBar()->showMessage(tr("Set DEM resampling to 'Bicubic'."));
+		break;
+	default:
+		submerge->m_resampling = Submerge::NEAREST_SAMPLING;
+		statusBar()->showMessage(tr("Set DEM resampling to 'Nearest'."));
+		break;
+	}
+}
+
+void QSSA::setTransformTolerance()
+{
+	bool ok;
+	const double tolerance = QInputDialog::getDouble(this, tr("Transform Tolerance"),
+		tr("Maximum error of the interpolated cross CRS registration (DEM pixels):"),
+		submerge->m_transformTolerance, 0, 16, 3, &ok);
+	if (!ok) { return; }
+
+	submerge->m_transformTolerance = tolerance;
+	statusBar()->showMessage(tr("Set transform tolerance to %1 DEM pixels.").arg(tolerance));
+}
+
+void QSSA::setFloodLevels()
+{
+	QStringList levels;
+	for (size_t i = 0; i < submerge->color_submerge.size(); i++) {
+		levels << QString::number(submerge->color_submerge[i].second);
+	}
+
+	bool ok;
+	const QString text = QInputDialog::getText(this, tr("Flood Levels"),
+		tr("Water levels of the %1 flood classes, from low to high (m):").arg(levels.size()),
+		QLineEdit::Normal, levels.join(", "), &ok);
+	if (!ok) { return; }
+
+	// one rising level per flood class colour
+	const QStringList items = text.split(',', QString::SkipEmptyParts);
+	std::vector<double> values;
+	for (int i = 0; i < items.size() && ok; i++) {
+		values.push_back(items[i].trimmed().toDouble(&ok));
+		ok = ok && (i == 0 || values[i] > values[i - 1]);
+	}
+	if (!ok || values.size() != submerge->color_submerge.size()) {
+		QMessageBox::critical(this, tr("Error!"),
+			tr("Please enter %1 rising water levels separated by commas.").arg(levels.size()));
+		return;
+	}
+	for (size_t i = 0; i < values.size(); i++) {
+		submerge->color_submerge[i].second = values[i];
+	}
+
+	// only the rendering depends on the levels, redo it from the cached grid
+	if (submerge->hasCachedGrid()) {
+		statusBar()->showMessage(tr("Re-rendering the flood levels from the registered grid ..."));
+		submerge->m_connectivity = eightConnectedAct->isChecked() ?
+			FloodFill::EIGHT_CONNECTED : FloodFill::FOUR_CONNECTED;
+		submerge->rerender();
+	}
+	else {
+		statusBar()->showMessage(tr("Set flood levels to %1 m.").arg(text));
+	}
+}
+
+void QSSA::setTileCacheSize()
+{
+	bool ok;
+	const int megabytes = QInputDialog::getInt(this, tr("Tile Cache Size"),
+		tr("Memory budget of the tile cache used by lazy layers (MB):"),
+		int(TileCache::instance()->budget() / (1024 * 1024)), 16, 1024 * 1024, 64, &ok);
+	if (!ok) { return; }
+
+	TileCache::instance()->setBudget(size_t(megabytes) * 1024 * 1024);
+	statusBar()->showMessage(tr("Set tile cache size to %1 MB").arg(megabytes));
+}
+
+void QSSA::setReaderThreads()
+{
+	bool ok;
+	const int threads = QInputDialog::getInt(this, tr("Reader Threads"),
+		tr("Number of threads decoding a file while it is loaded:"),
+		readerThreads, 1, 256, 1, &ok);
+	if (!ok) { return; }
+
+	readerThreads = threads;
+	statusBar()->showMessage(tr("Set reader threads to %1").arg(threads));
+}
+
 void QSSA::procHillshade()
 {
+	ScopedTimer timer("QSSA::procHillshade", "gdal");
 	QFileInfo fi(layerManager->getCurLayer()->m_filename);
 	QString dstName = "Data/Output/" + fi.baseName() + "_hillshade.tif";
 
@@ -567,6 +926,7 @@ void QSSA::procHillshade()
 
 void QSSA::procColorRelief()
 {
+	ScopedTimer timer("QSSA::procColorRelief", "gdal");
 	QFileInfo fi(layerManager->getCurLayer()->m_filename);
 	QString dstName = "Data/Output/" + fi.baseName() + "_color_relief.tif";
 
@@ -584,6 +944,7 @@ void QSSA::procColorRelief()
 
 void QSSA::procGDALInfo()
 {
+	ScopedTimer timer("QSSA::procGDALInfo", "gdal");
 	//char *papszArgv[] = { "-stats" };
 	/*const char *info = GDALInfo(GDALDatasetH(viewer->layerManager->getCurLayer()->m_dataset),
 		GDALInfoOptionsNew(papszArgv, NULL));*/
@@ -603,9 +964,69 @@ void QSSA::procGDALAddo()
 {
 }
 
+void QSSA::refreshProfiler()
+{
+	const Profiler *profiler = Profiler::instance();
+	profilerTree->clear();
+
+	// slowest stages first
+	const QList<Profiler::Stage> stages = profiler->stages();
+	for (int i = 0; i < stages.size(); i++) {
+		const Profiler::Stage& stage = stages[i];
+		QTreeWidgetItem *item = new QTreeWidgetItem(profilerTree);
+		item->setText(0, stage.name);
+		item->setToolTip(0, stage.category);
+		item->setText(1, QString::number(stage.calls));
+		item->setText(2, QString::number(stage.total / 1000.0, 'f', 1));
+		item->setText(3, QString::number(stage.total / 1000.0 / stage.calls, 'f', 2));
+		item->setText(4, QString::number(stage.max / 1000.0, 'f', 1));
+	}
+
+	// then the counters, value in the calls column
+	for (int i = 0; i < Profiler::COUNTER_COUNT; i++) {
+		QTreeWidgetItem *item = new QTreeWidgetItem(profilerTree);
+		item->setText(0, tr(Profiler::counterName((Profiler::Counter)i)));
+		item->setText(1, QString::number(profiler->counter((Profiler::Counter)i)));
+		item->setForeground(0, palette().color(QPalette::Disabled, QPalette::Text));
+	}
+
+	// scopes past the event budget are summed above but missing from traces
+	QTreeWidgetItem *droppedItem = new QTreeWidgetItem(profilerTree);
+	droppedItem->setText(0, tr("Dropped trace events"));
+	droppedItem->setText(1, QString::number(profiler->droppedEvents()));
+	droppedItem->setForeground(0, palette().color(QPalette::Disabled, QPalette::Text));
+
+	for (int c = 0; c < profilerTree->columnCount(); c++) {
+		profilerTree->resizeColumnToContents(c);
+	}
+}
+
+void QSSA::resetProfiler()
+{
+	Profiler::instance()->reset();
+	refreshProfiler();
+}
+
+void QSSA::exportTrace()
+{
+	const QString fileName = QFileDialog::getSaveFileName(this, tr("Export Trace"),
+		"Data/Output/qssa_trace.json", tr("Chrome Trace (*.json)"));
+	if (fileName.isEmpty()) { return; }
+
+	if (!Profiler::instance()->writeChromeTrace(fileName)) {
+		QMessageBox::critical(this, tr("Error!"), tr("Cannot write %1").arg(QDir::toNativeSeparators(fileName)));
+		return;
+	}
+	statusBar()->showMessage(tr("Wrote trace \"%1\", open it in chrome://tracing")
+		.arg(QDir::toNativeSeparators(fileName)));
+}
+
 void QSSA::runSubmerge()
 {
 	statusBar()->showMessage(tr("Start running submerging analysis, please waiting ..."));
+	submerge->m_connectivity = eightConnectedAct->isChecked() ?
+		FloodFill::EIGHT_CONNECTED : FloodFill::FOUR_CONNECTED;
+	submerge->m_streaming = streamingAct->isChecked();
 	submerge->run();
 }
 
@@ -616,15 +1037,88 @@ void QSSA::runProgress(int line)
 		.arg(submerge->m_landsat->m_height));
 }
 
+void QSSA::runError(const QString &message)
+{
+	statusBar()->showMessage(tr("Submerging analysis failed."));
+	QMessageBox::critical(this, tr("Error!"), message);
+}
+
 void QSSA::runFinish()
 {
 	statusBar()->showMessage(tr("Submerging analysis finished, already wrote results to 'Data/Output' folder."));
+	updateFloodOverlay();
+}
+
+void QSSA::toggleFloodOverlay(bool show)
+{
+	seaLevelSlider->setEnabled(show);
+	if (show) {
+		updateFloodOverlay();
+	}
+	else if (floodItem) {
+		floodItem->hide();
+	}
+}
+
+void QSSA::updateFloodOverlay()
+{
+	const double seaLevel = seaLevelSlider->value() / 10.0;
+	seaLevelLabel->setText(tr("Sea Level: %1 m").arg(seaLevel, 0, 'f', 1));
+	if (!overlayCheck->isChecked()) { return; }
+
+	// the grid is in the pixels of the landsat the analysis ran on
+	if (layerManager->getCurLayer() != submerge->m_landsat) {
+		if (floodItem) { floodItem->hide(); }
+		return;
+	}
+	if (!submerge->hasCachedGrid()) {
+		statusBar()->showMessage(tr("Run the submerging analysis first, the flood overlay uses its registered grid."));
+		return;
+	}
+	ScopedTimer timer("QSSA::updateFloodOverlay", "display");
+
+	// take the flood keys again whenever a run replaced the grid or onset
+	const QString key = QString("%1|%2|%3").arg(submerge->m_gridKey)
+		.arg(quintptr(submerge->m_elevation.data)).arg(quintptr(submerge->m_floodOnset.data));
+	if (key != overlayKey) {
+		cv::Mat floodKey;
+		submerge->floodKey(floodKey);
+		floodOverlay.setGrid(floodKey, submerge->m_elevation);
+		overlayKey = key;
+	}
+
+	// only the visible part of the scene, in landsat pixels, at screen resolution
+	QGraphicsView *view = viewer->view();
+	const QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+	const cv::Rect roi(qFloor(visible.left()), qFloor(visible.top()),
+		qCeil(visible.width()) + 1, qCeil(visible.height()) + 1);
+	const cv::Size size(qCeil(roi.width * viewer->scale()), qCeil(roi.height * viewer->scale()));
+	if (!floodOverlay.setView(roi, size)) {
+		if (floodItem) { floodItem->hide(); }
+		return;
+	}
+
+	cv::Mat argb;
+	floodOverlay.render(seaLevel, argb);
+	const QImage image(argb.data, argb.cols, argb.rows, (int)argb.step, QImage::Format_ARGB32_Premultiplied);
+
+	if (floodItem == nullptr) {
+		floodItem = new QGraphicsPixmapItem;
+		floodItem->setZValue(1);
+		scene->addItem(floodItem);
+	}
+	const cv::Rect& rect = floodOverlay.viewRect();
+	floodItem->setPixmap(QPixmap::fromImage(image));
+	floodItem->setPos(rect.x, rect.y);
+	floodItem->setTransform(QTransform::fromScale((qreal)rect.width / argb.cols, (qreal)rect.height / argb.rows));
+	floodItem->show();
 }
 
 bool QSSA::saveFile(const QString &fileName)
 {
 	Mat imageWrite;
-	cvtColor(layerManager->getCurLayer()->m_image, imageWrite, CV_RGB2BGR);
+	MapLayer *layer = layerManager->getCurLayer();
+	cvtColor(layer->window(cv::Rect(0, 0, layer->m_width, layer->m_height)), imageWrite, CV_RGB2BGR);
 	bool is_write = imwrite(fileName.toStdString(), imageWrite);
 
 	if (!is_write) 
@@ -687,14 +1181,21 @@ void QSSA::print()
 
 void QSSA::closeCurLayer()
 {
+	submerge->clearCache();
+	floodOverlay = FloodOverlay();
+	overlayKey.clear();
 	layerManager->removeLayer(layerManager->getCurLayer()->m_filename);
 	layerManager->updateLayerModel();
 	scene->clear();
+	floodItem = nullptr;
 	emit layerManager->layerChanged();
 }
 
 void QSSA::closeAllLayers()
 {
+	submerge->clearCache();
+	floodOverlay = FloodOverlay();
+	overlayKey.clear();
 	layerManager->removeAllLayers();
 	//layerManager->updateLayerModel();
 
@@ -702,6 +1203,7 @@ void QSSA::closeAllLayers()
 	dirTree = nullptr;
 	infoTree = nullptr;
 	scene->clear();
+	floodItem = nullptr;
 	emit layerManager->layerChanged();
 }
 
@@ -4,21 +4,26 @@
 #include <QMainWindow>
 #include <QImage>
 #ifndef QT_NO_PRINTER
-#include <QtPrintSupport\QPrinter>
+#include <QtPrintSupport/QPrinter>
 #endif
 
 #include "MapViewer.h"
 #include "MapLayerManager.h"
+#include "MapLayerLoader.h"
 #include "Submerge.h"
+#include "FloodOverlay.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
+class QCheckBox;
+class QSlider;
 class QGroupBox;
 class QLabel;
 class QMenu;
 class QScrollArea;
 class QScrollBar;
 class QTreeView;
+class QTreeWidget;
 class QTableView;
 class QGraphicsScene;
 class QGraphicsView;
@@ -37,6 +42,10 @@ public:
 private slots:
 	// file and edit
 	void open();
+	void loadProgress(int percent);
+	void loadPreview(QImage image);
+	void loadFinished(bool ok);
+	void cancelLoading();
 	void saveAs();
 	void print();
 	// view and other menu
@@ -50,6 +59,11 @@ private slots:
 	void selectionChangedSlot(const QItemSelection & newSelection, const QItemSelection & oldSelection);
 	// viewer 
 	void saveLastMousePosition(const QPoint p);
+	// settings
+	void setTileCacheSize();
+	void setReaderThreads();
+	void setTransformTolerance();
+	void setFloodLevels();
 	// processing
 	void procHillshade();
 	void procColorRelief();
@@ -60,11 +74,20 @@ private slots:
 	// submerge
 	void setDEM();
 	void setLandsat();
+	void setWater();
 	void setMatchMethod();
 	void setSubMethod();
+	void setResampling();
 	void runSubmerge();
 	void runProgress(int line);
 	void runFinish();
+	void runError(const QString &message);
+	void updateFloodOverlay();
+	void toggleFloodOverlay(bool show);
+	// profiler
+	void refreshProfiler();
+	void resetProfiler();
+	void exportTrace();
 
 private:
 	void setupCenter();
@@ -77,8 +100,11 @@ private:
 	void setupDockLayerWindow();
 	void setupDockInfoWindow();
 	void setupDockProcessWindow();
+	void setupDockProfilerWindow();
 
 	void updateActions();
+	void updateLoadStatus();
+	QStringList loadingFiles() const;
 	bool saveFile(const QString &fileName);
 
 	MapViewer *viewer = nullptr;
@@ -90,10 +116,13 @@ private:
 	QDockWidget *dockImgLayerWindow = nullptr;
 	QDockWidget *dockImgInfoWindow = nullptr;
 	QDockWidget *dockImgProcessWindow = nullptr;
+	QDockWidget *dockProfilerWindow = nullptr;
 	QFileSystemModel *fileModel = nullptr;
 	QTreeView *dirTree = nullptr;
 	QTreeView *infoTree = nullptr;
 	QTreeView *layerTree = nullptr;
+	QTreeWidget *profilerTree = nullptr;
+	QTimer *profilerTimer = nullptr;
 	// center view
 
 	// processing buttons
@@ -117,9 +146,19 @@ private:
 	/// Submerge 
 	QComboBox *demList = nullptr;
 	QComboBox *landsatList = nullptr;
+	QComboBox *waterList = nullptr;
 	QComboBox *matchList = nullptr;
 	QComboBox *submergeList = nullptr;
+	QComboBox *resampleList = nullptr;
 	QPushButton *submergePushBtn = nullptr;
+	QCheckBox *overlayCheck = nullptr;
+	QSlider *seaLevelSlider = nullptr;
+	QLabel *seaLevelLabel = nullptr;
+
+	/// Live flood overlay over the scene, on the registered grid of the last run
+	FloodOverlay floodOverlay;
+	QString overlayKey;
+	QGraphicsPixmapItem *floodItem = nullptr;
 
 #ifndef QT_NO_PRINTER
 	QPrinter printer;
@@ -141,6 +180,17 @@ private:
 	QAction *closeCurAct = nullptr;
 	QAction *setAsDEMAct = nullptr;
 	QAction *setAsLandsatAct = nullptr;
+
+	QAction *lazyLoadAct = nullptr;
+	QAction *eightConnectedAct = nullptr;
+	QAction *streamingAct = nullptr;
+	QAction *cancelLoadAct = nullptr;
+
+	/// Background loading
+	QHash<MapLayerLoader *, int> loaders;
+	QProgressBar *loadProgressBar = nullptr;
+	QToolButton *cancelLoadBtn = nullptr;
+	int readerThreads = QThread::idealThreadCount();
 };
 
 #endif // QSSA_H
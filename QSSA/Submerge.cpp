@@ -2,13 +2,36 @@
 * gdal_image.cpp -- Load GIS data into OpenCV Containers using the Geospatial Data Abstraction Library
 */
 
-#include "submerge.h"
+#include "Submerge.h"
+
+const int Submerge::TILED_BLOCK_SIZE;/// Bound to const int& by GeoTiffWriter::open
+const float Submerge::DEPTH_NODATA = -9999.0f;
 
 Submerge::Submerge()
 {
 	// default 
 	m_matchMethod = BASE_GEOGCS;
 	m_submergeMethod = PASSIVE_SUBMERGING;
+
+	// results go next to the working directory
+	m_outputDir = "Data/Output";
+
+	// define a minimum elevation, used outside the DEM
+	m_minElevation = -10;
+
+	// flood through diagonal neighbours too
+	m_connectivity = FloodFill::EIGHT_CONNECTED;
+
+	// sample the DEM cell each landsat pixel falls in
+	m_resampling = NEAREST_SAMPLING;
+
+	// interpolate cross CRS registration to within an eighth of a DEM pixel
+	m_transformTolerance = 0.125;
+	m_featureHomography = cv::Matx33d::eye();
+
+	// keep whole scenes in memory unless streaming is asked for
+	m_streaming = false;
+	m_tileSize = 2048;
 	
 	// define the color range to create our output DEM heat map
 	// Pair format ( Color, elevation );  Push from low to high
@@ -28,7 +51,7 @@ Submerge::Submerge()
 }
 Submerge::~Submerge()
 {
-
+	delete m_transformer;
 }
 
 bool Submerge::readConfig()
@@ -72,56 +95,6 @@ cv::Point2d Submerge::lerp(cv::Point2d const& p1, cv::Point2d const& p2, const d
 		((1 - t)*p1.y) + (t*p2.y));
 }
 
-/*
-* Interpolate Colors
-*/
-
-cv::Vec3b Submerge::lerp(cv::Vec3b const& minColor,
-	cv::Vec3b const& maxColor,
-	double const& t)
-{
-	cv::Vec3b output;
-	for (int i = 0; i<3; i++)
-	{
-		output[i] = (uchar)(((1 - t)*minColor[i]) + (t * maxColor[i]));
-	}
-	return output;
-}
-
-/*
-* Compute the dem color
-*/
-cv::Vec3b Submerge::get_dem_color(const double& elevation) {
-
-	// if the elevation is below the minimum, return the minimum
-	if (elevation < color_range[0].second) {
-		return color_range[0].first;
-	}
-	// if the elevation is above the maximum, return the maximum
-	if (elevation > color_range.back().second) {
-		return color_range.back().first;
-	}
-
-	// otherwise, find the proper starting index
-	int idx = 0;
-	double t = 0;
-	for (int x = 0; x<(int)(color_range.size() - 1); x++) {
-
-		// if the current elevation is below the next item, then use the current
-		// two colors as our range
-		if (elevation < color_range[x + 1].second) {
-			idx = x;
-			t = (color_range[x + 1].second - elevation) /
-				(color_range[x + 1].second - color_range[x].second);
-
-			break;
-		}
-	}
-
-	// interpolate the color
-	return lerp(color_range[idx].first, color_range[idx + 1].first, t);
-}
-
 ///*
 //* Convert a pixel coordinate to UTM coordinates
 //*/
@@ -176,6 +149,16 @@ cv::Point2d Submerge::world2dem(cv::Point2d const& coordinate, const cv::Size& d
 	return output;
 }
 
+/*
+* Record why a run failed and report it
+*/
+bool Submerge::fail(const QString& message)
+{
+	m_lastError = message;
+	emit submergeError(message);
+	return false;
+}
+
 /*
 * Add color to a specific pixel color value
 */
@@ -214,50 +197,39 @@ bool Submerge::run()
 	switch (m_matchMethod)
 	{
 	case Submerge::BASE_GEOGCS:
-		if (landsatSRS.IsGeographic() && demSRS.IsGeographic())
+	case Submerge::BASE_PROJCS:
+		// registration transforms between the two CRS, so any mix of
+		// geographic and projected layers works as long as both have one
+		if ((landsatSRS.IsGeographic() || landsatSRS.IsProjected()) &&
+			(demSRS.IsGeographic() || demSRS.IsProjected()))
 		{
 			if (m_submergeMethod == PASSIVE_SUBMERGING)
 			{
-				runWithCRSPsv();
+				return runWithCRSPsv();
 			}
 			else
 			{
-				runWithCRSPsv();
+				return runWithCRSAct();
 			}
-			
-			return true;
 		}
 		else
 		{
-			QMessageBox::critical(this, tr("Error!"), tr("The CRS of the selected files are not Geographic Coordinate System. Please check the information of each file."));
-			return false;
+			return fail(tr("The selected files have no Coordinate Reference System. Please check the information of each file."));
 		}
 		break;
-	case Submerge::BASE_PROJCS:
-		if (landsatSRS.IsProjected() && demSRS.IsProjected())
+	case Submerge::BASE_SIFT:
+	case Submerge::BASE_ORB:
+		// content based registration needs no CRS; the runs pick it up in
+		// prepareRegistration()
+		if (m_submergeMethod == PASSIVE_SUBMERGING)
 		{
-			if (m_submergeMethod == PASSIVE_SUBMERGING)
-			{
-				runWithCRSPsv();
-			}
-			else
-			{
-				runWithCRSPsv();
-			}
-			return true;
+			return runWithCRSPsv();
 		}
 		else
 		{
-			QMessageBox::critical(this, tr("Error!"), tr("The CRS of the selected files are not Projected Coordinate System. Please check the information of each file."));
-			return false;
+			return runWithCRSAct();
 		}
 		break;
-	case Submerge::BASE_SIFT:
-		//runWithSIFT();
-		break;
-	case Submerge::BASE_SURF:
-		//runWithSURF();
-		break;
 	default:
 		break;
 	}
@@ -305,10 +277,40 @@ bool Submerge::run()
 	{
 
 	}*/
-	return 0;
+	return fail(tr("The selected match method is not available."));
 }
 
-bool Submerge::runWithCRSPsv()
+/*
+* Set up the landsat -> DEM pixel transformation. Layers sharing a CRS map
+* affinely through the corners; otherwise a grid transformer is built.
+*/
+bool Submerge::prepareTransform()
+{
+	ScopedTimer timer("Submerge::prepareTransform", "registration");
+	delete m_transformer;
+	m_transformer = nullptr;
+
+	OGRSpatialReference landsatSRS;
+	OGRSpatialReference demSRS;
+	char *wkt = const_cast<char *>(m_landsat->m_dataset->GetProjectionRef());
+	landsatSRS.importFromWkt(&wkt);
+	wkt = const_cast<char *>(m_dem->m_dataset->GetProjectionRef());
+	demSRS.importFromWkt(&wkt);
+	if (landsatSRS.IsSame(&demSRS)) {
+		return true;
+	}
+
+	m_transformer = new GridTransformer;
+	m_transformer->setTolerance(m_transformTolerance);
+	if (!m_transformer->init(m_landsat->m_dataset, m_dem->m_dataset)) {
+		delete m_transformer;
+		m_transformer = nullptr;
+		return fail(tr("Cannot transform between the CRS of the selected files."));
+	}
+	return true;
+}
+
+void Submerge::setCorners()
 {
 	// define the corner points of landsat 
 	landsat_tl.x = m_landsat->m_origin.first;//0
@@ -335,74 +337,899 @@ bool Submerge::runWithCRSPsv()
 
 	dem_tr.x = dem_bl.x + m_dem->m_pixelSize.first * m_dem->m_width
 							+ m_dem->m_adfGeoTransform[2] * m_dem->m_height;
-	
-	// create output
-	cv::Mat output_dem(m_landsat->m_image.size(), CV_8UC3);
-	cv::Mat output_dem_flood(m_landsat->m_image.size(), CV_8UC3);
+}
+
+/*
+* Remap one block of the maps from the part of the DEM its valid samples
+* cover, halving the block along its longer side until that footprint is
+* small enough for cv::remap
+*/
+static void remap_block(const cv::Mat& dem, const cv::Mat& mapX, const cv::Mat& mapY,
+	const cv::Mat& valid, const int& interpolation, cv::Mat& dst)
+{
+	if (cv::countNonZero(valid) == 0) {
+		// masked out entirely
+		dst.setTo(0);
+		return;
+	}
+
+	const int margin = 2;/// Bicubic reads two pixels around the sample
+	double minX, maxX, minY, maxY;
+	cv::minMaxLoc(mapX, &minX, &maxX, NULL, NULL, valid);
+	cv::minMaxLoc(mapY, &minY, &maxY, NULL, NULL, valid);
+	const cv::Rect roi = cv::Rect(cv::Point(cvFloor(minX) - margin, cvFloor(minY) - margin),
+		cv::Point(cvCeil(maxX) + margin + 1, cvCeil(maxY) + margin + 1)) & cv::Rect(cv::Point(0, 0), dem.size());
+
+	// a single sample always fits
+	if ((roi.width < SHRT_MAX && roi.height < SHRT_MAX) || mapX.total() == 1) {
+		if (roi.width <= 0 || roi.height <= 0) {
+			dst.setTo(0);
+			return;
+		}
+		cv::Mat localX = mapX - (float)roi.x;
+		cv::Mat localY = mapY - (float)roi.y;
+		cv::remap(dem(roi), dst, localX, localY, interpolation, cv::BORDER_REPLICATE);
+		return;
+	}
+
+	cv::Rect first(0, 0, mapX.cols, mapX.rows);
+	cv::Rect second = first;
+	if (mapX.cols >= mapX.rows) {
+		first.width = mapX.cols / 2;
+		second.x = first.width;
+		second.width = mapX.cols - first.width;
+	}
+	else {
+		first.height = mapX.rows / 2;
+		second.y = first.height;
+		second.height = mapX.rows - first.height;
+	}
+	cv::Mat firstDst = dst(first);
+	cv::Mat secondDst = dst(second);
+	remap_block(dem, mapX(first), mapY(first), valid(first), interpolation, firstDst);
+	remap_block(dem, mapX(second), mapY(second), valid(second), interpolation, secondDst);
+}
+
+/*
+* Sample the DEM through the registration maps with cv::remap, whose row
+* kernels are vectorized. cv::remap only addresses sources below SHRT_MAX
+* pixels, so larger DEM windows are remapped block by block from the part
+* of the DEM each block covers, with the same interpolation everywhere.
+*/
+static void remap_dem(const cv::Mat& dem, const cv::Mat& mapX, const cv::Mat& mapY,
+	const cv::Mat& outOfBounds, const int& interpolation, cv::Mat& sampled)
+{
+	if (dem.cols < SHRT_MAX && dem.rows < SHRT_MAX) {
+		cv::remap(dem, sampled, mapX, mapY, interpolation, cv::BORDER_REPLICATE);
+		return;
+	}
+
+	// samples outside the DEM are masked later, they do not widen a block
+	const int blockSize = 1024;
+	sampled.create(mapX.size(), dem.type());
+	const cv::Mat valid = outOfBounds == 0;
+	for (int by = 0; by < mapX.rows; by += blockSize) {
+		for (int bx = 0; bx < mapX.cols; bx += blockSize) {
+			const cv::Rect block = cv::Rect(bx, by, blockSize, blockSize) & cv::Rect(cv::Point(0, 0), mapX.size());
+			cv::Mat dst = sampled(block);
+			remap_block(dem, mapX(block), mapY(block), valid(block), interpolation, dst);
+		}
+	}
+}
+
+/*
+* Resample the DEM onto the landsat grid. The landsat -> DEM pixel mapping is
+* affine, so it is computed once as an origin and a step per column and row,
+* stored as a pair of float maps, and the DEM is sampled in one cv::remap pass.
+* The result is kept in m_elevation (CV_32F, landsat size) together with the
+* mask of pixels that fall outside the DEM.
+*/
+bool Submerge::registerDem()
+{
+	// the grid only depends on the layers and the registration settings, so
+	// threshold and colour changes re-render from the cached one
+	const QString key = gridKey();
+	if (key == m_gridKey && !m_elevation.empty()) {
+		return buildColorRamp();
+	}
+	m_gridKey.clear();
+	m_onsetKey.clear();
+
+	if (!prepareRegistration()) { return false; }
+
+	// layers may be lazy, so work from their sizes rather than m_image
+	const cv::Rect landsatRect(0, 0, m_landsat->m_width, m_landsat->m_height);
+	registerTile(landsatRect, m_elevation, m_outOfBounds);
+	m_gridKey = key;
+	return buildColorRamp();
+}
+
+/*
+* Identity of the registered grid: the layer pair and everything the
+* registration and sampling depend on
+*/
+QString Submerge::gridKey() const
+{
+	if (m_landsat == nullptr || m_dem == nullptr) {
+		return QString();
+	}
+	return QString("%1|%2|%3|%4|%5|%6|%7|%8")
+		.arg(m_landsat->m_filename).arg(quintptr(m_landsat))
+		.arg(m_dem->m_filename).arg(quintptr(m_dem))
+		.arg(m_matchMethod).arg(m_resampling)
+		.arg(m_transformTolerance).arg(m_minElevation);
+}
+
+bool Submerge::hasCachedGrid() const
+{
+	return !m_elevation.empty() && !m_gridKey.isEmpty() && m_gridKey == gridKey();
+}
+
+/*
+* Drop the cached grid, e.g. when one of its layers is closed
+*/
+void Submerge::clearCache()
+{
+	m_gridKey.clear();
+	m_onsetKey.clear();
+	m_waterKey.clear();
+	m_waterMask.release();
+	m_elevation.release();
+	m_outOfBounds.release();
+	m_floodOnset.release();
+	m_floodLevel.release();
+}
+
+/*
+* Render the outputs again from the cached grid after the flood levels or
+* colours changed, without registering or sampling the DEM
+*/
+bool Submerge::rerender()
+{
+	ScopedTimer timer("Submerge::rerender", "submerge");
+	if (!hasCachedGrid()) {
+		return fail(tr("There is no registered grid for the selected layers, run the analysis first."));
+	}
+	if (!buildColorRamp()) { return false; }
+
+	if (m_submergeMethod == ACTIVE_SUBMERGING) {
+		if (!floodConnected()) { return false; }
+	}
+	else {
+		m_floodLevel.release();
+		m_floodOnset.release();
+		m_onsetKey.clear();
+	}
+	return renderOutput();
+}
+
+/*
+* Set up the registration of the match method: the CRS transformation, or
+* the homography estimated from image features
+*/
+bool Submerge::prepareRegistration()
+{
+	if (m_matchMethod == BASE_SIFT || m_matchMethod == BASE_ORB) {
+		return registerFeatures();
+	}
+	setCorners();
+	return prepareTransform();
+}
+
+/*
+* Estimate the landsat to DEM homography on image pyramids, once per layer
+* pair and detector.
+*/
+bool Submerge::registerFeatures()
+{
+	const QString key = QString("%1|%2|%3|%4|%5")
+		.arg(m_landsat->m_filename).arg(quintptr(m_landsat))
+		.arg(m_dem->m_filename).arg(quintptr(m_dem)).arg(m_matchMethod);
+	if (key == m_featureKey) {
+		return true;
+	}
+	m_featureKey.clear();
+
+	FeatureRegistration registration;
+	registration.setDetector(m_matchMethod == BASE_SIFT ?
+		FeatureRegistration::SIFT_DETECTOR : FeatureRegistration::ORB_DETECTOR);
+	if (!registration.estimate(m_landsat, m_dem)) {
+		return fail(registration.m_lastError);
+	}
+	m_featureHomography = registration.homography();
+	m_featureKey = key;
+	return true;
+}
+
+/*
+* Resample the DEM under one landsat tile, reading only the DEM window the
+* tile covers
+*/
+void Submerge::registerTile(const cv::Rect& tile, cv::Mat& elevation, cv::Mat& outOfBounds)
+{
+	cv::Rect demRoi;
+	cv::Mat mapX;
+	cv::Mat mapY;
+	registerMaps(tile, demRoi, mapX, mapY, outOfBounds);
+	sampleDem(demRoi, mapX, mapY, outOfBounds, elevation);
+}
+
+/*
+* Registration of a landsat tile: the DEM window it covers and, for each
+* tile pixel, its position in that window and whether it falls outside
+*/
+void Submerge::registerMaps(const cv::Rect& tile, cv::Rect& demRoi, cv::Mat& mapX, cv::Mat& mapY, cv::Mat& outOfBounds)
+{
+	ScopedTimer timer("Submerge::registerMaps", "registration");
+	const cv::Size demSize(m_dem->m_width, m_dem->m_height);
 
-	// define a minimum elevation
-	double minElevation = -10;//-10
+	if (m_matchMethod == BASE_SIFT || m_matchMethod == BASE_ORB) {
+		// feature registration: project the tile through the homography
+		const cv::Matx33d& H = m_featureHomography;
+		std::vector<cv::Point2f> corners;
+		corners.push_back(cv::Point2f((float)tile.x, (float)tile.y));
+		corners.push_back(cv::Point2f((float)(tile.x + tile.width), (float)tile.y));
+		corners.push_back(cv::Point2f((float)tile.x, (float)(tile.y + tile.height)));
+		corners.push_back(cv::Point2f((float)(tile.x + tile.width), (float)(tile.y + tile.height)));
+		std::vector<cv::Point2f> footprint;
+		cv::perspectiveTransform(corners, footprint, cv::Matx33f(H));
+		demRoi = cv::boundingRect(footprint);
+		demRoi = cv::Rect(demRoi.x - 2, demRoi.y - 2, demRoi.width + 4, demRoi.height + 4)
+			& cv::Rect(cv::Point(0, 0), demSize);
 
-	// iterate over each pixel in the image, computing the dem point
-	for (int y = 0; y<m_landsat->m_image.rows; y++) {
-		emit submergeProgress(y);
-		for (int x = 0; x<m_landsat->m_image.cols; x++) {
+		// numerator and denominator are linear along a row
+		mapX.create(tile.size(), CV_32FC1);
+		mapY.create(tile.size(), CV_32FC1);
+		for (int y = 0; y < tile.height; y++) {
+			const double py = tile.y + y;
+			float *mx = mapX.ptr<float>(y);
+			float *my = mapY.ptr<float>(y);
+			for (int x = 0; x < tile.width; x++) {
+				const double px = tile.x + x;
+				const double w = H(2, 0) * px + H(2, 1) * py + H(2, 2);
+				if (w <= 0) {
+					mx[x] = my[x] = std::numeric_limits<float>::quiet_NaN();
+					continue;
+				}
+				mx[x] = (float)((H(0, 0) * px + H(0, 1) * py + H(0, 2)) / w - demRoi.x);
+				my[x] = (float)((H(1, 0) * px + H(1, 1) * py + H(1, 2)) / w - demRoi.y);
+			}
+		}
+	}
+	else if (m_transformer) {
+		// different CRS: transform a control grid and interpolate between
+		demRoi = m_transformer->bounds(tile);
+		demRoi = cv::Rect(demRoi.x - 2, demRoi.y - 2, demRoi.width + 4, demRoi.height + 4)
+			& cv::Rect(cv::Point(0, 0), demSize);
+		m_transformer->mapTile(tile, demRoi.tl(), mapX, mapY);
+	}
+	else {
+		const cv::Size landsatSize(m_landsat->m_width, m_landsat->m_height);
 
-			// convert the pixel coordinate to lat/lon coordinates
-			cv::Point2d coordinate = pixel2world(x, y, m_landsat->m_image.size());
+		// DEM position of the first landsat pixel and its per column / row steps
+		const cv::Point2d origin = world2dem(pixel2world(0, 0, landsatSize), demSize);
+		const cv::Point2d stepX = world2dem(pixel2world(1, 0, landsatSize), demSize) - origin;
+		const cv::Point2d stepY = world2dem(pixel2world(0, 1, landsatSize), demSize) - origin;
+		const cv::Point2d tileOrigin = origin + stepX * tile.x + stepY * tile.y;
 
-			// compute the dem image pixel coordinate from lat/lon
-			cv::Point2d dem_coordinate = world2dem(coordinate, m_dem->m_image.size());
+		// only the part of the DEM under the tile footprint is needed
+		std::vector<cv::Point2f> footprint;
+		footprint.push_back(tileOrigin);
+		footprint.push_back(tileOrigin + stepX * tile.width);
+		footprint.push_back(tileOrigin + stepY * tile.height);
+		footprint.push_back(tileOrigin + stepX * tile.width + stepY * tile.height);
+		demRoi = cv::boundingRect(footprint);
+		// with a margin for the bicubic kernel
+		demRoi = cv::Rect(demRoi.x - 2, demRoi.y - 2, demRoi.width + 4, demRoi.height + 4)
+			& cv::Rect(cv::Point(0, 0), demSize);
 
-			// extract the elevation
-			double dz;
-			if (dem_coordinate.x >= 0 && dem_coordinate.y >= 0 &&
-				dem_coordinate.x < m_dem->m_image.cols && dem_coordinate.y < m_dem->m_image.rows) {
-				dz = m_dem->m_image.at<short>(dem_coordinate);
+		// build the registration maps, relative to the DEM window
+		mapX.create(tile.size(), CV_32FC1);
+		mapY.create(tile.size(), CV_32FC1);
+		for (int y = 0; y < tile.height; y++) {
+			const cv::Point2d row = tileOrigin + stepY * y;
+			float *mx = mapX.ptr<float>(y);
+			float *my = mapY.ptr<float>(y);
+			for (int x = 0; x < tile.width; x++) {
+				mx[x] = (float)(row.x + stepX.x * x - demRoi.x);
+				my[x] = (float)(row.y + stepX.y * x - demRoi.y);
 			}
-			else {
-				dz = minElevation;
+		}
+	}
+
+	// outside the DEM, untransformable, or rounding onto a pixel outside
+	// the window read
+	outOfBounds.create(tile.size(), CV_8UC1);
+	for (int y = 0; y < tile.height; y++) {
+		float *mx = mapX.ptr<float>(y);
+		float *my = mapY.ptr<float>(y);
+		uchar *oob = outOfBounds.ptr<uchar>(y);
+		for (int x = 0; x < tile.width; x++) {
+			if (std::isnan(mx[x]) || std::isnan(my[x])) {
+				// keep cv::remap on valid coordinates, the mask hides the result
+				mx[x] = 0;
+				my[x] = 0;
+				oob[x] = 255;
+				continue;
 			}
+			const int px = cvRound(mx[x]);
+			const int py = cvRound(my[x]);
+			oob[x] = (mx[x] + demRoi.x < 0 || my[x] + demRoi.y < 0 ||
+				px < 0 || py < 0 || px >= demRoi.width || py >= demRoi.height) ? 255 : 0;
+		}
+	}
+}
+
+/*
+* Sample the DEM window through the registration maps
+*/
+void Submerge::sampleDem(const cv::Rect& demRoi, const cv::Mat& mapX, const cv::Mat& mapY,
+	const cv::Mat& outOfBounds, cv::Mat& elevation)
+{
+	ScopedTimer timer("Submerge::sampleDem", "sampling");
+	Profiler::instance()->add(Profiler::PIXELS_SAMPLED, (qint64)mapX.total());
+	Profiler::instance()->add(Profiler::OUT_OF_BOUNDS_SAMPLES, cv::countNonZero(outOfBounds));
 
-			// write the pixel value to the file
-			output_dem_flood.at<cv::Vec3b>(y, x) = m_landsat->m_image.at<cv::Vec3b>(y, x);
+	cv::Mat dem = m_dem->window(demRoi);
 
-			// compute the color for the heat map output
-			cv::Vec3b actualColor = get_dem_color(dz);
-			output_dem.at<cv::Vec3b>(y, x) = actualColor;
+	// sample the DEM; nearest keeps the DEM values, the interpolating modes
+	// work in float so the result is not rounded back to the DEM type
+	cv::Mat sampled;
+	if (dem.empty()) {
+		sampled = cv::Mat(mapX.size(), CV_32FC1, cv::Scalar(m_minElevation));
+	}
+	else {
+		int interpolation = cv::INTER_NEAREST;
+		cv::Mat sourceX = mapX;
+		cv::Mat sourceY = mapY;
+		if (m_resampling != NEAREST_SAMPLING) {
+			interpolation = m_resampling == BICUBIC_SAMPLING ? cv::INTER_CUBIC : cv::INTER_LINEAR;
+			dem.convertTo(dem, CV_32F);
+			// the maps hold pixel corner positions while cv::remap
+			// interpolates between pixel centres
+			sourceX = mapX - 0.5f;
+			sourceY = mapY - 0.5f;
+		}
+		remap_dem(dem, sourceX, sourceY, outOfBounds, interpolation, sampled);
+	}
+
+	sampled.convertTo(elevation, CV_32F);
+	elevation.setTo(m_minElevation, outOfBounds);
+}
+
+/*
+* Compile the heat map colors for the DEM data type
+*/
+bool Submerge::buildColorRamp()
+{
+	// integer DEMs sampled without interpolation can use the exact per
+	// value color table
+	const bool integral = m_resampling == NEAREST_SAMPLING &&
+		CV_MAT_DEPTH(m_dem->m_cvType) < CV_32F && m_minElevation == std::floor(m_minElevation);
+	m_colorRamp.setStops(color_range);
+	if (!m_colorRamp.build(integral)) {
+		return fail(tr("Cannot build the heat map color table."));
+	}
+	return true;
+}
 
+/*
+* Render one row of the heat map and flood images
+*/
+void Submerge::renderRow(const float *elevation, const uchar *level, const cv::Vec3b *landsat,
+	cv::Vec3b *heatmap, cv::Vec3b *flood, const int& width)
+{
+	// compute the colors for the heat map output
+	m_colorRamp.apply(elevation, heatmap, width);
+
+	for (int x = 0; x<width; x++) {
+		// extract the registered elevation
+		double dz = elevation[x];
+
+		// write the pixel value to the file
+		flood[x] = landsat[x];
+
+		if (level) {
+			// connected flooding, the lowest water level reaching the cell
+			if (level[x] != 255) {
+				add_color(flood[x], color_submerge[level[x]].first);
+			}
+		}
+		else {
 			// show effect of a 10 meter increase in ocean levels
 			if (dz < color_submerge[0].second) {
-				add_color(output_dem_flood.at<cv::Vec3b>(y, x), color_submerge[0].first);
+				add_color(flood[x], color_submerge[0].first);
 			}
 			else if (dz < color_submerge[1].second) {
-				add_color(output_dem_flood.at<cv::Vec3b>(y, x), color_submerge[1].first);
+				add_color(flood[x], color_submerge[1].first);
 			}
 			// show effect of a 50 meter increase in ocean levels
 			else if (dz < color_submerge[2].second) {
-				add_color(output_dem_flood.at<cv::Vec3b>(y, x), color_submerge[2].first);
+				add_color(flood[x], color_submerge[2].first);
 			}
 			// show effect of a 100 meter increase in ocean levels
 			else if (dz < color_submerge[3].second) {
-				add_color(output_dem_flood.at<cv::Vec3b>(y, x), color_submerge[3].first);
+				add_color(flood[x], color_submerge[3].first);
 			}
 		}
 	}
+}
 
-	// print our heat map
-	QFileInfo landFI(m_dem->m_filename);
-	QString heatmapDstName = "Data/Output/" + landFI.baseName() + "_heatmpa.jpg";
-	cv::imwrite(heatmapDstName.toStdString(), output_dem);
+/*
+* Flood class and depth of one row: the lowest colour level flooding each
+* cell (255 when none does) and the water depth at the highest level
+*/
+void Submerge::classifyRow(const float *elevation, const uchar *level, const uchar *outOfBounds,
+	uchar *classes, float *depth, const int& width)
+{
+	// passive rendering shows the first four levels, active ones all of them
+	const int levels = std::min((int)color_submerge.size(), level ? 255 : 4);
+	const double top = levels > 0 ? color_submerge[levels - 1].second : 0;
+
+	for (int x = 0; x < width; x++) {
+		if (outOfBounds && outOfBounds[x]) {
+			classes[x] = 255;
+			depth[x] = DEPTH_NODATA;
+			continue;
+		}
+
+		uchar c = 255;
+		if (level) {
+			c = level[x];
+		}
+		else {
+			for (int i = 0; i < levels; i++) {
+				if (elevation[x] < color_submerge[i].second) {
+					c = (uchar)i;
+					break;
+				}
+			}
+		}
+		classes[x] = c;
+		depth[x] = c != 255 ? (float)(top - elevation[x]) : 0.0f;
+	}
+}
+
+/*
+* Render the heat map, flood, class and depth rows of a row band
+*/
+void Submerge::renderRows(const cv::Range& rows, cv::Mat& output_dem, cv::Mat& output_dem_flood,
+	cv::Mat& output_class, cv::Mat& output_depth)
+{
+	const int width = output_dem.cols;
+
+	// one landsat window for the whole band
+	cv::Mat landsat = m_landsat->window(cv::Rect(0, rows.start, width, rows.size()));
+	for (int y = rows.start; y < rows.end; y++) {
+		const uchar *level = m_floodLevel.empty() ? nullptr : m_floodLevel.ptr<uchar>(y);
+		renderRow(m_elevation.ptr<float>(y), level,
+			landsat.ptr<cv::Vec3b>(y - rows.start),
+			output_dem.ptr<cv::Vec3b>(y), output_dem_flood.ptr<cv::Vec3b>(y), width);
+		classifyRow(m_elevation.ptr<float>(y), level,
+			m_outOfBounds.empty() ? nullptr : m_outOfBounds.ptr<uchar>(y),
+			output_class.ptr<uchar>(y), output_depth.ptr<float>(y), width);
+	}
+}
+
+/*
+* Row band worker for cv::parallel_for_
+*/
+class SubmergeRowsInvoker : public cv::ParallelLoopBody
+{
+public:
+	SubmergeRowsInvoker(Submerge *submerge, cv::Mat& output_dem, cv::Mat& output_dem_flood,
+		cv::Mat& output_class, cv::Mat& output_depth)
+		: m_submerge(submerge), m_outputDem(output_dem), m_outputFlood(output_dem_flood),
+		m_outputClass(output_class), m_outputDepth(output_depth)
+	{
+	}
+
+	void operator()(const cv::Range& rows) const override
+	{
+		m_submerge->renderRows(rows, m_outputDem, m_outputFlood, m_outputClass, m_outputDepth);
+	}
+
+private:
+	Submerge *m_submerge;
+	cv::Mat& m_outputDem;
+	cv::Mat& m_outputFlood;
+	cv::Mat& m_outputClass;
+	cv::Mat& m_outputDepth;
+};
+
+/*
+* Render a strip of rows on all cores in bands of ROW_BAND_ROWS rows; the
+* band count is explicit so no backend hands out single rows
+*/
+static void render_strip(Submerge *submerge, const cv::Range& rows, cv::Mat& output_dem,
+	cv::Mat& output_dem_flood, cv::Mat& output_class, cv::Mat& output_depth)
+{
+	const int bands = (rows.size() + Submerge::ROW_BAND_ROWS - 1) / Submerge::ROW_BAND_ROWS;
+	cv::parallel_for_(rows,
+		SubmergeRowsInvoker(submerge, output_dem, output_dem_flood, output_class, output_depth), bands);
+}
+
+bool Submerge::runWithCRSPsv()
+{
+	ScopedTimer timer("Submerge::runWithCRSPsv", "submerge");
+
+	// regional scenes are streamed tile by tile into GeoTIFFs
+	if (m_streaming) {
+		if (!prepareRegistration()) { return false; }
+		return runTiledPsv();
+	}
+
+	// resample the DEM onto the landsat grid, unless it is cached
+	if (!registerDem()) { return false; }
+
+	// every cell below a water level floods
+	m_floodLevel.release();
+	m_floodOnset.release();
+	m_onsetKey.clear();
+	return renderOutput();
+}
+
+/*
+* Create the georeferenced outputs on the landsat grid: heat map, flood
+* image, flood classes and flood depth
+*/
+bool Submerge::openWriters(GeoTiffWriter& heatmap, GeoTiffWriter& flood, GeoTiffWriter& classes, GeoTiffWriter& depth)
+{
+	QFileInfo demFI(m_dem->m_filename);
+	QFileInfo landsatFI(m_landsat->m_filename);
+	const QString baseName = m_outputDir + "/" + landsatFI.baseName();
+	const cv::Size size(m_landsat->m_width, m_landsat->m_height);
+	const double *geoTransform = m_landsat->m_adfGeoTransform;
+	const char *projection = m_landsat->m_dataset->GetProjectionRef();
+
+	if (!heatmap.open(m_outputDir + "/" + demFI.baseName() + "_heatmap.tif", size, 3, GDT_Byte,
+			geoTransform, projection, TILED_BLOCK_SIZE) ||
+		!flood.open(baseName + "_flood.tif", size, 3, GDT_Byte, geoTransform, projection, TILED_BLOCK_SIZE) ||
+		!classes.open(baseName + "_flood_class.tif", size, 1, GDT_Byte, geoTransform, projection, TILED_BLOCK_SIZE) ||
+		!depth.open(baseName + "_flood_depth.tif", size, 1, GDT_Float32, geoTransform, projection, TILED_BLOCK_SIZE)) {
+		heatmap.close();
+		flood.close();
+		classes.close();
+		depth.close();
+		return fail(tr("Cannot create the output files in '%1'.").arg(m_outputDir));
+	}
+	classes.setNoData(255);
+	depth.setNoData(DEPTH_NODATA);
+	return true;
+}
+
+/*
+* Finish all outputs, even when one of them failed
+*/
+bool Submerge::closeWriters(GeoTiffWriter& heatmap, GeoTiffWriter& flood, GeoTiffWriter& classes, GeoTiffWriter& depth)
+{
+	bool written = heatmap.close();
+	written = flood.close() && written;
+	written = classes.close() && written;
+	written = depth.close() && written;
+	if (!written) {
+		return fail(tr("Failed writing the output files in '%1'.").arg(m_outputDir));
+	}
+	return true;
+}
+
+/*
+* Passive submerging in bounded memory: the landsat grid is processed tile
+* by tile, each tile reading only its landsat and DEM windows, and the
+* results are encoded into tiled GeoTIFFs while the next tile is computed
+*/
+bool Submerge::runTiledPsv()
+{
+	if (!buildColorRamp()) { return false; }
+	m_floodLevel.release();
+	m_floodOnset.release();
 
-	// print the flooding effect image
-	QFileInfo demFI(m_landsat->m_filename);
-	QString floodDstName = "Data/Output/" + demFI.baseName() + "_flood.jpg";
-	Mat output_dem_flood_write;
-	cvtColor(output_dem_flood, output_dem_flood_write, CV_RGB2BGR);
-	cv::imwrite(floodDstName.toStdString(), output_dem_flood_write);
+	GeoTiffWriter heatmapWriter;
+	GeoTiffWriter floodWriter;
+	GeoTiffWriter classWriter;
+	GeoTiffWriter depthWriter;
+	if (!openWriters(heatmapWriter, floodWriter, classWriter, depthWriter)) { return false; }
+
+	// tiles are whole multiples of the output blocks
+	const int tileSize = std::max(1, m_tileSize / TILED_BLOCK_SIZE) * TILED_BLOCK_SIZE;
+	cv::Mat elevation;
+	cv::Mat outOfBounds;
+	for (int ty = 0; ty < m_landsat->m_height; ty += tileSize) {
+		for (int tx = 0; tx < m_landsat->m_width; tx += tileSize) {
+			const cv::Rect tile = cv::Rect(tx, ty, tileSize, tileSize)
+				& cv::Rect(0, 0, m_landsat->m_width, m_landsat->m_height);
+
+			registerTile(tile, elevation, outOfBounds);
+			cv::Mat landsat = m_landsat->window(tile);
+
+			// fresh buffers per tile, the writers still hold the previous ones
+			cv::Mat heatmap(tile.size(), CV_8UC3);
+			cv::Mat flood(tile.size(), CV_8UC3);
+			cv::Mat classes(tile.size(), CV_8UC1);
+			cv::Mat depth(tile.size(), CV_32FC1);
+			{
+				ScopedTimer timer("Submerge::renderTile", "render");
+				for (int y = 0; y < tile.height; y++) {
+					renderRow(elevation.ptr<float>(y), nullptr, landsat.ptr<cv::Vec3b>(y),
+						heatmap.ptr<cv::Vec3b>(y), flood.ptr<cv::Vec3b>(y), tile.width);
+					classifyRow(elevation.ptr<float>(y), nullptr, outOfBounds.ptr<uchar>(y),
+						classes.ptr<uchar>(y), depth.ptr<float>(y), tile.width);
+				}
+			}
+
+			heatmapWriter.write(tile, heatmap, true);
+			floodWriter.write(tile, flood);
+			classWriter.write(tile, classes);
+			depthWriter.write(tile, depth);
+		}
+		emit submergeProgress(std::min(ty + tileSize, m_landsat->m_height));
+	}
+
+	if (!closeWriters(heatmapWriter, floodWriter, classWriter, depthWriter)) { return false; }
 
 	emit submergeFinish();
 	return true;
+}
+
+/*
+* Connected inundation: a cell only floods when the sea reaches it through
+* cells below the water level
+*/
+bool Submerge::runWithCRSAct()
+{
+	ScopedTimer timer("Submerge::runWithCRSAct", "submerge");
+
+	// resample the DEM onto the landsat grid, unless it is cached
+	if (!registerDem()) { return false; }
+	if (!floodConnected()) { return false; }
+	return renderOutput();
+}
+
+/*
+* Resample the water layer onto the landsat grid as the seed mask of active
+* submerging: nonzero pixels of its first band are water, as is nothing
+* outside it. Without a water layer the mask is dropped.
+*/
+bool Submerge::registerWaterMask()
+{
+	if (m_water == nullptr) {
+		m_waterKey.clear();
+		m_waterMask.release();
+		return true;
+	}
+	const QString key = QString("%1|%2|%3|%4")
+		.arg(m_landsat->m_filename).arg(quintptr(m_landsat))
+		.arg(m_water->m_filename).arg(quintptr(m_water));
+	if (key == m_waterKey && !m_waterMask.empty()) {
+		return true;
+	}
+	m_waterKey.clear();
+
+	ScopedTimer timer("Submerge::registerWaterMask", "registration");
+	GridTransformer transformer;
+	transformer.setTolerance(m_transformTolerance);
+	if (!transformer.init(m_landsat->m_dataset, m_water->m_dataset)) {
+		return fail(tr("Cannot transform between the CRS of the landsat and the water files."));
+	}
+
+	// landsat tiles map to water windows, read them one at a time so lazy
+	// water layers stay lazy
+	const cv::Rect landsatRect(0, 0, m_landsat->m_width, m_landsat->m_height);
+	const cv::Rect waterRect(0, 0, m_water->m_width, m_water->m_height);
+	const int tileSize = std::max(1, m_tileSize);
+	m_waterMask.create(landsatRect.size(), CV_8UC1);
+	cv::Mat mapX, mapY, band, water;
+	for (int ty = 0; ty < landsatRect.height; ty += tileSize) {
+		for (int tx = 0; tx < landsatRect.width; tx += tileSize) {
+			const cv::Rect tile = cv::Rect(tx, ty, tileSize, tileSize) & landsatRect;
+			cv::Mat seeds = m_waterMask(tile);
+			const cv::Rect roi = transformer.bounds(tile) & waterRect;
+			if (roi.empty()) {
+				seeds.setTo(0);
+				continue;
+			}
+
+			cv::Mat window = m_water->window(roi);
+			if (window.channels() > 1) {
+				cv::extractChannel(window, band, 0);
+			}
+			else {
+				band = window;
+			}
+			cv::compare(band, 0, water, cv::CMP_NE);
+
+			// untransformable positions are NaN, send them off the window
+			transformer.mapTile(tile, roi.tl(), mapX, mapY);
+			cv::patchNaNs(mapX, -1);
+			cv::patchNaNs(mapY, -1);
+			cv::remap(water, seeds, mapX, mapY, cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(0));
+		}
+	}
+	m_waterKey = key;
+	return true;
+}
+
+/*
+* Compute the flood onset raster in one priority-flood pass, then record
+* the lowest colour level that floods each cell (255 when none does)
+*/
+bool Submerge::floodConnected()
+{
+	ScopedTimer timer("Submerge::floodConnected", "classification");
+	if (!registerWaterMask()) { return false; }
+
+	// the onset only depends on the cached grid, the connectivity and the
+	// seeds, so new water levels reuse it
+	const QString onsetKey = m_gridKey.isEmpty() ? QString() : QString("%1|%2|%3")
+		.arg(m_gridKey).arg(m_connectivity).arg(m_waterKey);
+	if (onsetKey.isEmpty() || onsetKey != m_onsetKey || m_floodOnset.empty()) {
+		FloodFill flood;
+		flood.setElevation(m_elevation, m_outOfBounds);
+		flood.setConnectivity(m_connectivity);
+
+		// seed from the water mask if one was given, the DEM edges otherwise
+		if (!m_waterMask.empty() && m_waterMask.size() == m_elevation.size()) {
+			flood.seedMask(m_waterMask);
+		}
+		else {
+			flood.seedEdges(0);
+		}
+		flood.onset(m_floodOnset);
+		m_onsetKey = onsetKey;
+	}
+
+	m_floodLevel.create(m_elevation.size(), CV_8UC1);
+	m_floodLevel.setTo(255);
+
+	// water levels rise, so keep the lowest level that floods a cell
+	const int levels = std::min((int)color_submerge.size(), 255);
+	cv::Mat flooded;
+	cv::Mat unset;
+	for (int i = 0; i < levels; i++) {
+		floodAt(color_submerge[i].second, flooded);
+		cv::compare(m_floodLevel, 255, unset, cv::CMP_EQ);
+		cv::bitwise_and(flooded, unset, flooded);
+		m_floodLevel.setTo(i, flooded);
+	}
+	return true;
+}
+
+/*
+* Cells connected-flooded at a water level, from the onset raster of the
+* last active run
+*/
+bool Submerge::floodAt(const double& waterLevel, cv::Mat& mask) const
+{
+	if (m_floodOnset.empty()) {
+		return false;
+	}
+	cv::compare(m_floodOnset, waterLevel, mask, cv::CMP_LT);
+	return true;
+}
+
+/*
+* DEM cells flooded at a water level by the last in-memory run: connected
+* cells after active submerging, every cell below the level otherwise
+*/
+bool Submerge::floodMask(const double& waterLevel, cv::Mat& mask) const
+{
+	if (!m_floodOnset.empty()) {
+		return floodAt(waterLevel, mask);
+	}
+	if (m_elevation.empty()) {
+		return false;
+	}
+	cv::compare(m_elevation, waterLevel, mask, cv::CMP_LT);
+	mask.setTo(0, m_outOfBounds);
+	return true;
+}
+
+/*
+* Water level above which each cell of the last in-memory run floods, for
+* live overlays: the onset after active submerging, the elevation otherwise,
+* and +inf where a cell never floods
+*/
+bool Submerge::floodKey(cv::Mat& key) const
+{
+	if (!m_floodOnset.empty()) {
+		key = m_floodOnset;
+		return true;
+	}
+	if (m_elevation.empty()) {
+		return false;
+	}
+	m_elevation.copyTo(key);
+	key.setTo(std::numeric_limits<float>::infinity(), m_outOfBounds);
+	return true;
+}
+
+/*
+* Render the outputs of the registered grid in strips of whole output
+* blocks, each strip being encoded in the background while the next one
+* is rendered
+*/
+bool Submerge::renderOutput()
+{
+	GeoTiffWriter heatmapWriter;
+	GeoTiffWriter floodWriter;
+	GeoTiffWriter classWriter;
+	GeoTiffWriter depthWriter;
+	if (!openWriters(heatmapWriter, floodWriter, classWriter, depthWriter)) { return false; }
+
+	const cv::Size landsatSize(m_landsat->m_width, m_landsat->m_height);
+	cv::Mat output_dem(landsatSize, CV_8UC3);
+	cv::Mat output_dem_flood(landsatSize, CV_8UC3);
+	cv::Mat output_class(landsatSize, CV_8UC1);
+	cv::Mat output_depth(landsatSize, CV_32FC1);
+
+	// the strips are views, the images stay alive until the writers are done
+	const int stripRows = std::max(1, m_tileSize / TILED_BLOCK_SIZE) * TILED_BLOCK_SIZE;
+	for (int y = 0; y < landsatSize.height; y += stripRows) {
+		const cv::Range rows(y, std::min(y + stripRows, landsatSize.height));
+		{
+			ScopedTimer timer("Submerge::renderStrip", "render");
+			render_strip(this, rows, output_dem, output_dem_flood, output_class, output_depth);
+		}
+		emit submergeProgress(rows.end);
+
+		const cv::Rect strip(0, rows.start, landsatSize.width, rows.size());
+		heatmapWriter.write(strip, output_dem.rowRange(rows), true);
+		floodWriter.write(strip, output_dem_flood.rowRange(rows));
+		classWriter.write(strip, output_class.rowRange(rows));
+		depthWriter.write(strip, output_depth.rowRange(rows));
+	}
+
+	if (!closeWriters(heatmapWriter, floodWriter, classWriter, depthWriter)) { return false; }
+
+	emit submergeFinish();
+	return true;
+}
+
+/*
+* Render the heat map (BGR), flood (RGB), flood class and flood depth
+* images of the whole grid
+*/
+void Submerge::renderImages(cv::Mat& output_dem, cv::Mat& output_dem_flood,
+	cv::Mat& output_class, cv::Mat& output_depth)
+{
+	ScopedTimer timer("Submerge::renderImages", "render");
+	const cv::Size landsatSize(m_landsat->m_width, m_landsat->m_height);
+
+	// create output
+	output_dem.create(landsatSize, CV_8UC3);
+	output_dem_flood.create(landsatSize, CV_8UC3);
+	output_class.create(landsatSize, CV_8UC1);
+	output_depth.create(landsatSize, CV_32FC1);
+
+	// render row bands on all cores; rows are independent, so the output
+	// matches the serial loop exactly. Progress is reported from this
+	// thread, one strip at a time.
+	const int stripRows = std::max(1, m_tileSize / TILED_BLOCK_SIZE) * TILED_BLOCK_SIZE;
+	for (int y = 0; y < landsatSize.height; y += stripRows) {
+		const cv::Range rows(y, std::min(y + stripRows, landsatSize.height));
+		render_strip(this, rows, output_dem, output_dem_flood, output_class, output_depth);
+		emit submergeProgress(rows.end);
+	}
+}
+
+/*
+* Write rendered images to the output folder in one go
+*/
+bool Submerge::writeImages(const cv::Mat& output_dem, const cv::Mat& output_dem_flood,
+	const cv::Mat& output_class, const cv::Mat& output_depth)
+{
+	GeoTiffWriter heatmapWriter;
+	GeoTiffWriter floodWriter;
+	GeoTiffWriter classWriter;
+	GeoTiffWriter depthWriter;
+	if (!openWriters(heatmapWriter, floodWriter, classWriter, depthWriter)) { return false; }
+
+	const cv::Rect grid(0, 0, output_dem.cols, output_dem.rows);
+	heatmapWriter.write(grid, output_dem, true);
+	floodWriter.write(grid, output_dem_flood);
+	classWriter.write(grid, output_class);
+	depthWriter.write(grid, output_depth);
+	return closeWriters(heatmapWriter, floodWriter, classWriter, depthWriter);
 	/*QMessageBox::about(this,
 		tr("Submerge Information"),
 		tr("(%1,%2) "
@@ -414,109 +1241,3 @@ bool Submerge::runWithCRSPsv()
 		.arg(landsat_tr.x).arg(landsat_tr.y)
 		.arg(landsat_br.x).arg(landsat_br.y));*/
 }
-
-//bool Submerge::runWithCRSAct()
-//{
-//	// define the corner points of landsat 
-//	landsat_tl.x = m_landsat->m_origin.first;//0
-//	landsat_tl.y = m_landsat->m_origin.second;//3
-//
-//	landsat_br.x = landsat_tl.x + m_landsat->m_pixelSize.first * m_landsat->m_width
-//		+ m_landsat->m_adfGeoTransform[2] * m_landsat->m_height;
-//
-//	landsat_br.y = landsat_tl.y + m_landsat->m_adfGeoTransform[2] * m_landsat->m_width
-//		+ m_landsat->m_pixelSize.second * m_landsat->m_height;
-//
-//	landsat_tr.x = landsat_br.x;
-//	landsat_tr.y = landsat_tl.y;
-//
-//	landsat_bl.x = landsat_tl.x;
-//	landsat_bl.y = landsat_br.y;
-//
-//	// define the corner points of dem
-//	dem_bl.x = m_dem->m_origin.first;
-//	dem_tr.y = m_dem->m_origin.second;
-//
-//	dem_bl.y = dem_tr.y + m_dem->m_adfGeoTransform[2] * m_dem->m_width
-//		+ m_dem->m_pixelSize.second * m_dem->m_height;
-//
-//	dem_tr.x = dem_bl.x + m_dem->m_pixelSize.first * m_dem->m_width
-//		+ m_dem->m_adfGeoTransform[2] * m_dem->m_height;
-//
-//	// create output
-//	cv::Mat output_dem(m_landsat->m_image.size(), CV_8UC3);
-//	cv::Mat output_dem_flood(m_landsat->m_image.size(), CV_8UC3);
-//
-//	// define a minimum elevation
-//	double minElevation = -10;
-//	cv::Point2d seedPoint;
-//	double dz = -10;
-//	cv::Mat isSubmerge(m_landsat->m_image.size(), CV_8UC1);
-//
-//	// iterate over each pixel in the image, computing the first seed point
-//	for (int y = 0; y < m_landsat->m_image.rows && dz != 0; y++) {
-//		for (int x = 0; x < m_landsat->m_image.cols && dz != 0; x++) {
-//			// convert the pixel coordinate to lat/lon coordinates
-//			cv::Point2d coordinate = pixel2world(x, y, m_landsat->m_image.size());
-//
-//			// compute the dem image pixel coordinate from lat/lon
-//			cv::Point2d dem_coordinate = world2dem(coordinate, m_dem->m_image.size());
-//
-//			// extract the elevation and seek for seed point
-//			if (dem_coordinate.x >= 0 && dem_coordinate.y >= 0 &&
-//				dem_coordinate.x < m_dem->m_image.cols && dem_coordinate.y < m_dem->m_image.rows) {
-//				dz = m_dem->m_image.at<short>(dem_coordinate);
-//				if (dz == 0) { seedPoint = cv::Point2d(x, y); }
-//			}
-//			else {
-//				dz = minElevation;
-//			}
-//		}
-//	}
-//
-//	// iterate over each pixel in the image, computing dem point
-//	for (int y = seedPoint.y; y < m_landsat->m_image.rows; y++)
-//	{
-//		for (int x = seedPoint.x; x < m_landsat->m_image.cols; x++)
-//		{
-//			if (y - 1 > 0 && y + 1 < m_landsat->m_image.rows &&
-//				x - 1 > 0 && x + 1 < m_landsat->m_image.cols)
-//			{
-//				cv::Point2i tl = (x - 1, y - 1);
-//				cv::Point2i tm = (x    , y - 1);
-//				cv::Point2i tr = (x + 1, y - 1);
-//				cv::Point2i ml = (x - 1, y    );
-//				cv::Point2i mr = (x + 1, y    );
-//				cv::Point2i bl = (x - 1, y + 1);
-//				cv::Point2i bm = (x    , y + 1);
-//				cv::Point2i br = (x + 1, y + 1);
-//				vector<Point2i> around;
-//				around.push_back(tl);
-//				around.push_back(tm);
-//				around.push_back(tr);
-//				around.push_back(ml);
-//				around.push_back(mr);
-//				around.push_back(bl);
-//				around.push_back(bm);
-//				around.push_back(br);
-//				//ֱdzʼɫ
-//				//һ
-//				//cv::Point2d nextSeed = findSeed(around);
-//				
-//			}
-//			
-//			
-//		}
-//	}
-//}
-//Point2d findSeed(vector<Point2i> around)
-//{
-//	/*cv::Point2d coordinate = pixel2world(x, y, m_landsat->m_image.size());
-//	cv::Point2d dem_coordinate = world2dem(coordinate, m_dem->m_image.size());
-//	dz = m_dem->m_image.at<short>(dem_coordinate);*/
-//
-//	/*if (dem_coordinate.x >= 0 && dem_coordinate.y >= 0 &&
-//	dem_coordinate.x < m_dem->m_image.cols && dem_coordinate.y < m_dem->m_image.rows) {
-//	dz = m_dem->m_image.at<short>(dem_coordinate);
-//	}*/
-//}
\ No newline at end of file
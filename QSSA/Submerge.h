@@ -1,12 +1,12 @@
 #pragma once
 
 // Qt Header
-#include <QtWidgets>
+#include <QtCore>
 
 // OpenCV Headers
 #include "opencv2/core.hpp"
 #include "opencv2/imgproc.hpp"
-#include "opencv2/highgui.hpp"
+#include "opencv2/imgcodecs.hpp"
 
 // GDAL Headers
 #include <gdal_priv.h>
@@ -16,20 +16,28 @@
 #include <ogr_spatialref.h>
 
 // C++ Standard Libraries
+#include <climits>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <stdexcept>
 #include <vector>
 
 // User Headers
+#include "ColorRamp.h"
+#include "FeatureRegistration.h"
+#include "FloodFill.h"
+#include "GeoTiffWriter.h"
+#include "GridTransformer.h"
 #include "MapLayer.h"
+#include "Profiler.h"
 
 
 using namespace std;
 
 
-class Submerge : public QWidget
+class Submerge : public QObject
 {
 	Q_OBJECT
 public:
@@ -37,9 +45,13 @@ public:
 	~Submerge();
 	bool readConfig();
 
+	QString m_outputDir;/// Folder the results are written to
+	QString m_lastError;/// Reason the last run failed
+
 	// define files
 	MapLayer *m_landsat = nullptr;
 	MapLayer *m_dem = nullptr;
+	MapLayer *m_water = nullptr;/// Optional water raster, nonzero band 1 pixels seed active submerging
 
 	// define the corner points
 	cv::Point2d landsat_tl;
@@ -50,30 +62,69 @@ public:
 	cv::Point2d dem_bl;
 	cv::Point2d dem_tr;
 
+	// registered elevation grid: the DEM resampled onto the landsat grid
+	double m_minElevation;
+	cv::Mat m_elevation;
+	cv::Mat m_outOfBounds;
+
+	// active submerging: optional water mask on the landsat grid seeding the
+	// fill, the flood onset elevation and the lowest flooding colour level
+	// of each cell; m_waterKey names the layer pair the mask was registered
+	// from and is empty without one
+	cv::Mat m_waterMask;
+	QString m_waterKey;
+	cv::Mat m_floodOnset;
+	cv::Mat m_floodLevel;
+	FloodFill::Connectivity m_connectivity;
+
+	// cache keys of the registered grid and of the flood onset computed on
+	// it; runs with the same layers and settings skip the registration
+	QString m_gridKey;
+	QString m_onsetKey;
+
+	// cross CRS registration, null when both layers share a CRS
+	GridTransformer *m_transformer = nullptr;
+	double m_transformTolerance;/// Allowed interpolation error, in DEM pixels
+
+	// feature based registration: landsat pixel to DEM pixel homography and
+	// the layer pair it was estimated for
+	cv::Matx33d m_featureHomography;
+	QString m_featureKey;
+
+	// outputs are tiled GeoTIFFs on the landsat grid; m_tileSize also sets
+	// the strips the in-memory runs hand to the background writers
+	static const int TILED_BLOCK_SIZE = 256;
+	static const float DEPTH_NODATA;/// Flood depth outside the DEM
+	bool m_streaming;/// Passive submerging tile by tile, without the whole grid in memory
+	int m_tileSize;/// Landsat pixels per tile side, rounded to whole output blocks
+	static const int ROW_BAND_ROWS = 64;/// Rows a render worker takes at once
+
 	// define methods used
 	enum MatchMethod
 	{
 		BASE_GEOGCS = 0,
 		BASE_PROJCS = 1,
 		BASE_SIFT = 2,
-		BASE_SURF = 3
+		BASE_ORB = 3
 	}m_matchMethod;
 	enum SubmergeMethod
 	{
 		PASSIVE_SUBMERGING = 0,
 		ACTIVE_SUBMERGING = 1
 	}m_submergeMethod;
+	enum ResamplingMethod
+	{
+		NEAREST_SAMPLING = 0,
+		BILINEAR_SAMPLING = 1,
+		BICUBIC_SAMPLING = 2
+	}m_resampling;
 
 	// range of the heat map colors
 	std::vector<std::pair<cv::Vec3b, double> > color_range;
 	std::vector<std::pair<cv::Vec3b, double> > color_submerge;
+	ColorRamp m_colorRamp;
 	// List of all function prototypes
 	cv::Point2d lerp(const cv::Point2d&, const cv::Point2d&, const double&);
-	cv::Vec3b Submerge::lerp(
-		cv::Vec3b const& minColor, 
-		cv::Vec3b const& maxColor,
-		double const& t);
-	cv::Vec3b get_dem_color(const double&);
 
 	//cv::Point2d pixel2utm(const int&, const int&, const cv::Size&);
 	//void utm2world();
@@ -81,15 +132,52 @@ public:
 	cv::Point2d pixel2world(const int&, const int&, const cv::Size&);
 	void add_color(cv::Vec3b& pix, const uchar& b, const uchar& g, const uchar& r);
 	void add_color(cv::Vec3b& pix, cv::Vec3b color);
+	void setCorners();
+	bool prepareTransform();
+	bool registerFeatures();
+	bool prepareRegistration();
+	bool registerDem();
+	QString gridKey() const;
+	bool hasCachedGrid() const;
+	void clearCache();
+	bool rerender();
+	void registerTile(const cv::Rect& tile, cv::Mat& elevation, cv::Mat& outOfBounds);
+	void registerMaps(const cv::Rect& tile, cv::Rect& demRoi, cv::Mat& mapX, cv::Mat& mapY, cv::Mat& outOfBounds);
+	void sampleDem(const cv::Rect& demRoi, const cv::Mat& mapX, const cv::Mat& mapY,
+		const cv::Mat& outOfBounds, cv::Mat& elevation);
+	bool buildColorRamp();
+	void renderRow(const float *elevation, const uchar *level, const cv::Vec3b *landsat,
+		cv::Vec3b *heatmap, cv::Vec3b *flood, const int& width);
+	void classifyRow(const float *elevation, const uchar *level, const uchar *outOfBounds,
+		uchar *classes, float *depth, const int& width);
+	void renderRows(const cv::Range& rows, cv::Mat& output_dem, cv::Mat& output_dem_flood,
+		cv::Mat& output_class, cv::Mat& output_depth);
 	bool run();
+	bool registerWaterMask();
+	bool floodConnected();
+	bool floodAt(const double& waterLevel, cv::Mat& mask) const;
+	bool renderOutput();
+	void renderImages(cv::Mat& output_dem, cv::Mat& output_dem_flood,
+		cv::Mat& output_class, cv::Mat& output_depth);
+	bool writeImages(const cv::Mat& output_dem, const cv::Mat& output_dem_flood,
+		const cv::Mat& output_class, const cv::Mat& output_depth);
 	bool runWithCRSPsv();
-	//bool runWithCRSAct();
+	bool runTiledPsv();
+	bool runWithCRSAct();
+	bool floodMask(const double& waterLevel, cv::Mat& mask) const;
+	bool floodKey(cv::Mat& key) const;
 	//bool runWithFeaturePsv();
 	//bool runWithFeatureAct();
 
 signals:
 	void submergeFinish();
 	void submergeProgress(int line);
+	void submergeError(const QString& message);
+
+private:
+	bool fail(const QString& message);
+	bool openWriters(GeoTiffWriter& heatmap, GeoTiffWriter& flood, GeoTiffWriter& classes, GeoTiffWriter& depth);
+	bool closeWriters(GeoTiffWriter& heatmap, GeoTiffWriter& flood, GeoTiffWriter& classes, GeoTiffWriter& depth);
 
 };
 
@@ -0,0 +1,112 @@
+#include "TileCache.h"
+
+// User Headers
+#include "Profiler.h"
+
+TileCache::TileCache(size_t budget)
+{
+	m_budget = budget;
+	m_usage = 0;
+}
+
+TileCache::~TileCache()
+{
+	clear();
+}
+
+TileCache *TileCache::instance()
+{
+	static TileCache cache;
+	return &cache;
+}
+
+void TileCache::setBudget(size_t bytes)
+{
+	QMutexLocker locker(&m_mutex);
+	m_budget = bytes;
+	evict();
+}
+
+size_t TileCache::budget() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_budget;
+}
+
+size_t TileCache::usage() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_usage;
+}
+
+bool TileCache::get(const Key& key, cv::Mat& tile)
+{
+	QMutexLocker locker(&m_mutex);
+
+	QHash<Key, TileList::iterator>::iterator it = m_index.find(key);
+	if (it == m_index.end()) {
+		Profiler::instance()->add(Profiler::CACHE_MISSES);
+		return false;
+	}
+
+	// move the tile to the front of the list
+	m_tiles.splice(m_tiles.begin(), m_tiles, it.value());
+	tile = it.value()->second;
+	Profiler::instance()->add(Profiler::CACHE_HITS);
+	return true;
+}
+
+void TileCache::put(const Key& key, const cv::Mat& tile)
+{
+	QMutexLocker locker(&m_mutex);
+
+	// another thread may have loaded the same tile meanwhile
+	QHash<Key, TileList::iterator>::iterator it = m_index.find(key);
+	if (it != m_index.end()) {
+		m_usage -= it.value()->second.total() * it.value()->second.elemSize();
+		m_tiles.erase(it.value());
+		m_index.erase(it);
+	}
+
+	m_tiles.push_front(std::make_pair(key, tile));
+	m_index.insert(key, m_tiles.begin());
+	m_usage += tile.total() * tile.elemSize();
+
+	evict();
+}
+
+void TileCache::remove(const void *owner)
+{
+	QMutexLocker locker(&m_mutex);
+
+	TileList::iterator it = m_tiles.begin();
+	while (it != m_tiles.end()) {
+		if (it->first.owner == owner) {
+			m_usage -= it->second.total() * it->second.elemSize();
+			m_index.remove(it->first);
+			it = m_tiles.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void TileCache::clear()
+{
+	QMutexLocker locker(&m_mutex);
+	m_tiles.clear();
+	m_index.clear();
+	m_usage = 0;
+}
+
+void TileCache::evict()
+{
+	// always keep the most recent tile, even if it alone exceeds the budget
+	while (m_usage > m_budget && m_tiles.size() > 1) {
+		const std::pair<Key, cv::Mat>& last = m_tiles.back();
+		m_usage -= last.second.total() * last.second.elemSize();
+		m_index.remove(last.first);
+		m_tiles.pop_back();
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Qt Headers
+#include <QtCore>
+
+// OpenCV Headers
+#include <opencv2/core.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <list>
+#include <utility>
+
+/**
+* Bounded, thread-safe LRU cache of raster tiles shared by all lazy layers.
+* Tiles are keyed by their owning layer and tile column/row, and the least
+* recently used ones are dropped once the byte budget is exceeded. Hits and
+* misses are counted by the Profiler.
+*/
+class TileCache
+{
+public:
+	struct Key
+	{
+		const void *owner;
+		int x;
+		int y;
+
+		bool operator==(const Key& other) const
+		{
+			return owner == other.owner && x == other.x && y == other.y;
+		}
+	};
+
+	explicit TileCache(size_t budget = 512 * 1024 * 1024);
+	~TileCache();
+
+	static TileCache *instance();
+
+	void setBudget(size_t bytes);
+	size_t budget() const;
+	size_t usage() const;
+
+	bool get(const Key& key, cv::Mat& tile);
+	void put(const Key& key, const cv::Mat& tile);
+	void remove(const void *owner);
+	void clear();
+
+private:
+	typedef std::list<std::pair<Key, cv::Mat> > TileList;
+
+	void evict();
+
+	TileList m_tiles;/// most recently used first
+	QHash<Key, TileList::iterator> m_index;
+	size_t m_budget;
+	size_t m_usage;
+	mutable QMutex m_mutex;
+};
+
+inline uint qHash(const TileCache::Key& key, uint seed = 0)
+{
+	return qHash(quintptr(key.owner), seed) ^ qHash(key.x, seed) ^ qHash(key.y << 16, seed);
+}
@@ -0,0 +1,578 @@
+/*
+* qssa_bench.cpp -- Time the stages of the submerging analysis on synthetic scenes
+*/
+
+// Qt Headers
+#include <QtCore>
+
+// User Headers
+#include "MapLayer.h"
+#include "Submerge.h"
+
+enum Terrain
+{
+	RAMP_TERRAIN = 0,
+	FRACTAL_TERRAIN = 1,
+	SHELF_TERRAIN = 2
+};
+
+static const char *TERRAIN_NAMES[] = { "ramp", "fractal", "shelf" };
+
+/*
+* Synthetic DEM in metres (CV_16SC1). Ramps rise from the sea across the
+* scene, fractal terrain sums octaves of smoothed noise, and coastal shelves
+* drop off steeply offshore behind a gently rising coastal plain.
+*/
+static cv::Mat make_dem(const Terrain& terrain, const cv::Size& size, cv::RNG& rng)
+{
+	cv::Mat elevation(size, CV_32FC1);
+	if (terrain == RAMP_TERRAIN) {
+		for (int y = 0; y < size.height; y++) {
+			float *row = elevation.ptr<float>(y);
+			for (int x = 0; x < size.width; x++) {
+				row[x] = -20.0f + 140.0f * x / size.width;
+			}
+		}
+	}
+	else {
+		// octaves of bicubically upsampled uniform noise
+		elevation.setTo(0);
+		double amplitude = 1.0;
+		for (int cells = 4; cells <= std::min(size.width, size.height) && cells <= 1024; cells *= 2) {
+			cv::Mat noise(cells, cells, CV_32FC1);
+			rng.fill(noise, cv::RNG::UNIFORM, -1.0, 1.0);
+			cv::Mat octave;
+			cv::resize(noise, octave, size, 0, 0, cv::INTER_CUBIC);
+			cv::scaleAdd(octave, amplitude, elevation, elevation);
+			amplitude *= 0.5;
+		}
+		cv::normalize(elevation, elevation, -60, 240, cv::NORM_MINMAX);
+
+		if (terrain == SHELF_TERRAIN) {
+			// flatten the noise to a tenth and put it on a shelf profile
+			for (int y = 0; y < size.height; y++) {
+				float *row = elevation.ptr<float>(y);
+				for (int x = 0; x < size.width; x++) {
+					const double coast = (double)x / size.width - 0.4;
+					const double profile = coast < 0 ? -5 + 400 * coast : 150 * coast;
+					row[x] = (float)(profile + row[x] * 0.1);
+				}
+			}
+		}
+	}
+
+	cv::Mat dem;
+	elevation.convertTo(dem, CV_16S);
+	return dem;
+}
+
+/*
+* Landsat-like RGB scene (CV_8UC3): water, lowland, forest and bare ground
+* colours by elevation, plus sensor noise
+*/
+static cv::Mat make_landsat(const cv::Mat& dem, const cv::Size& size, cv::RNG& rng)
+{
+	cv::Mat palette(1, 256, CV_8UC3);
+	for (int i = 0; i < 256; i++) {
+		const double z = -60 + 300.0 * i / 255;/// Elevation of the palette entry
+		cv::Vec3b rgb;
+		if (z < 0) { rgb = cv::Vec3b(20, 50 + (uchar)(z + 60) / 2, 110 + (uchar)(z + 60)); }
+		else if (z < 20) { rgb = cv::Vec3b(150, 160, 110); }
+		else if (z < 120) { rgb = cv::Vec3b(60, 110, 50); }
+		else { rgb = cv::Vec3b(140, 120, 90); }
+		palette.at<cv::Vec3b>(0, i) = rgb;
+	}
+
+	cv::Mat upsampled;
+	cv::resize(dem, upsampled, size, 0, 0, cv::INTER_LINEAR);
+	cv::Mat index;
+	upsampled.convertTo(index, CV_8U, 255.0 / 300, 60 * 255.0 / 300);
+	cv::Mat index3;
+	cv::cvtColor(index, index3, cv::COLOR_GRAY2RGB);
+
+	cv::Mat image;
+	cv::LUT(index3, palette, image);
+	cv::Mat noise(size, CV_8UC3);
+	rng.fill(noise, cv::RNG::UNIFORM, 0, 16);
+	cv::add(image, noise, image);
+	return image;
+}
+
+/*
+* Write an image as a GeoTIFF, one band per channel
+*/
+static bool write_raster(const QString& fileName, const cv::Mat& image, const double geoTransform[6], const std::string& wkt)
+{
+	GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+	if (driver == NULL) {
+		return false;
+	}
+
+	const GDALDataType type = image.depth() == CV_16S ? GDT_Int16 :
+		image.depth() == CV_32F ? GDT_Float32 : GDT_Byte;
+	GDALDataset *dataset = driver->Create(fileName.toLocal8Bit().constData(),
+		image.cols, image.rows, image.channels(), type, NULL);
+	if (dataset == NULL) {
+		return false;
+	}
+
+	double transform[6];
+	std::copy(geoTransform, geoTransform + 6, transform);
+	dataset->SetGeoTransform(transform);
+	dataset->SetProjection(wkt.c_str());
+	const int pixelSpace = (int)image.elemSize();
+	const bool ok = dataset->RasterIO(GF_Write, 0, 0, image.cols, image.rows, image.data,
+		image.cols, image.rows, type, image.channels(), NULL,
+		pixelSpace, (GSpacing)image.step, (GSpacing)image.elemSize1()) == CE_None;
+	GDALClose(dataset);
+	return ok;
+}
+
+static MapLayer *open_layer(const QString& fileName, const int& threads)
+{
+	MapLayer *layer = new MapLayer(fileName);
+	layer->m_ioThreads = threads;
+	if (!layer->readHeader()) {
+		delete layer;
+		return nullptr;
+	}
+	layer->initMatData();
+	if (!layer->readData()) {
+		delete layer;
+		return nullptr;
+	}
+	// the exact statistics pass would otherwise overlap the timed stages
+	layer->waitForStatistics();
+	return layer;
+}
+
+/*
+* Sample a linear ramp DEM, one metre per column and two per row, with the
+* interpolating modes and compare every Landsat pixel away from the
+* replicated border with the ramp at its registered position
+*/
+static bool check_ramp_sampling(const QString& workDir, const std::string& wkt, QTextStream& out, QTextStream& err)
+{
+	const cv::Size landsatSize(512, 512);
+	const cv::Size demSize(256, 256);
+	const double landsatGeo[6] = { 120, 1.0 / landsatSize.width, 0, 31, 0, -1.0 / landsatSize.height };
+	const double demGeo[6] = { 120, 1.0 / demSize.width, 0, 31, 0, -1.0 / demSize.height };
+
+	cv::Mat dem(demSize, CV_16SC1);
+	for (int y = 0; y < demSize.height; y++) {
+		short *row = dem.ptr<short>(y);
+		for (int x = 0; x < demSize.width; x++) {
+			row[x] = (short)(x + 2 * y);
+		}
+	}
+	const QString demName = workDir + "/dem_check.tif";
+	const QString landsatName = workDir + "/landsat_check.tif";
+	if (!write_raster(demName, dem, demGeo, wkt) ||
+		!write_raster(landsatName, cv::Mat(landsatSize, CV_8UC3, cv::Scalar::all(0)), landsatGeo, wkt)) {
+		err << "Cannot write the ramp rasters to " << workDir << "." << endl;
+		return false;
+	}
+	QScopedPointer<MapLayer> demLayer(open_layer(demName, QThread::idealThreadCount()));
+	QScopedPointer<MapLayer> landsatLayer(open_layer(landsatName, QThread::idealThreadCount()));
+	if (!demLayer || !landsatLayer) {
+		err << "Cannot read the ramp rasters back." << endl;
+		return false;
+	}
+
+	bool ok = true;
+	const Submerge::ResamplingMethod modes[] = { Submerge::BILINEAR_SAMPLING, Submerge::BICUBIC_SAMPLING };
+	const char *modeNames[] = { "bilinear", "bicubic" };
+	for (int i = 0; i < 2; i++) {
+		Submerge submerge;
+		submerge.m_dem = demLayer.data();
+		submerge.m_landsat = landsatLayer.data();
+		submerge.m_resampling = modes[i];
+		submerge.setCorners();
+		submerge.prepareTransform();
+		submerge.registerTile(cv::Rect(cv::Point(0, 0), landsatSize), submerge.m_elevation, submerge.m_outOfBounds);
+
+		// the ramp value of DEM pixel j is at its centre, j + 0.5
+		const double ratio = (double)demSize.width / landsatSize.width;
+		double worst = 0;
+		for (int y = 0; y < landsatSize.height; y++) {
+			const double v = y * ratio - 0.5;
+			const float *row = submerge.m_elevation.ptr<float>(y);
+			for (int x = 0; x < landsatSize.width; x++) {
+				const double u = x * ratio - 0.5;
+				if (u < 2 || v < 2 || u > demSize.width - 3 || v > demSize.height - 3) {
+					continue;
+				}
+				worst = std::max(worst, std::abs(row[x] - (u + 2 * v)));
+			}
+		}
+		out << "ramp check\t" << modeNames[i] << "\tmax error " << worst << " m" << endl;
+		if (worst > 0.01) {
+			err << "The " << modeNames[i] << " sampling is off the ramp by " << worst << " m." << endl;
+			ok = false;
+		}
+	}
+
+	StatisticsCache::remove(demName);
+	StatisticsCache::remove(landsatName);
+	VSIUnlink(demName.toLocal8Bit().constData());
+	VSIUnlink(landsatName.toLocal8Bit().constData());
+	return ok;
+}
+
+/*
+* Time the row converters of MapLayer for every source type and channel
+* layout, interleaving all bands of a 4096 x 256 block a few times over
+*/
+static QJsonArray bench_conversion(QTextStream& out)
+{
+	const GDALDataType types[] = { GDT_Byte, GDT_UInt16, GDT_Int16, GDT_UInt32, GDT_Int32, GDT_Float32, GDT_Float64 };
+	const int channelCounts[] = { 1, 3, 4, 5 };
+	const int width = 4096;
+	const int rows = 256;
+	const int repeats = 8;
+
+	QJsonArray results;
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+		const std::vector<uchar> band((size_t)width * (GDALGetDataTypeSize(types[t]) / 8), 1);
+		std::vector<double> values(width);
+		GDALCopyWords(band.data(), types[t], GDALGetDataTypeSize(types[t]) / 8,
+			values.data(), GDT_Float64, sizeof(double), width);
+		for (size_t n = 0; n < sizeof(channelCounts) / sizeof(channelCounts[0]); n++) {
+			const int channels = channelCounts[n];
+			const int cvType = gdal2opencv(types[t], channels);
+			if (cvType == -1) { continue; }
+			const RowConverter convert = select_row_converter(types[t], CV_MAT_DEPTH(cvType), channels);
+			if (convert == NULL) { continue; }
+
+			cv::Mat image(rows, width, cvType);
+			QElapsedTimer timer;
+			timer.start();
+			for (int r = 0; r < repeats; r++) {
+				for (int y = 0; y < rows; y++) {
+					for (int c = 0; c < channels; c++) {
+						convert(band.data(), image.ptr(y), width, channels, c);
+					}
+				}
+			}
+			const double ms = timer.nsecsElapsed() / 1e6;
+
+			// the per pixel path the converters replaced, on the same row read
+			// as doubles the way readBlock used to; the widening itself is left
+			// out of the timing
+			timer.start();
+			for (int r = 0; r < repeats; r++) {
+				for (int y = 0; y < rows; y++) {
+					for (int c = 0; c < channels; c++) {
+						for (int x = 0; x < width; x++) {
+							write_pixel(values[x], types[t], channels, image, y, x, c);
+						}
+					}
+				}
+			}
+			const double pixelMs = timer.nsecsElapsed() / 1e6;
+
+			const double pixels = (double)width * rows * repeats / 1e6;
+			const double rate = pixels / std::max(ms, 1e-3) * 1000;
+			const double pixelRate = pixels / std::max(pixelMs, 1e-3) * 1000;
+			const double speedup = pixelMs / std::max(ms, 1e-3);
+
+			QJsonObject result;
+			result["type"] = QString(GDALGetDataTypeName(types[t]));
+			result["channels"] = channels;
+			result["ms"] = ms;
+			result["mpixel_per_s"] = rate;
+			result["write_pixel_ms"] = pixelMs;
+			result["write_pixel_mpixel_per_s"] = pixelRate;
+			result["speedup"] = speedup;
+			results.append(result);
+			out << "conversion\t" << GDALGetDataTypeName(types[t]) << "\t" << channels << "\t"
+				<< ms << "\t" << rate << "\t" << pixelMs << "\t" << pixelRate << "\t" << speedup << "x" << endl;
+		}
+	}
+	return results;
+}
+
+/*
+* Band statistics of a float raster with NaN and infinite samples: both the
+* exact and the approximate pass have to finish and skip them
+*/
+static bool check_statistics(const QString& workDir, const std::string& wkt, QTextStream& out, QTextStream& err)
+{
+	const cv::Size size(2048, 64);
+	const double geo[6] = { 120, 1.0 / size.width, 0, 31, 0, -1.0 / size.height };
+	cv::Mat band(size, CV_32FC1);
+	for (int y = 0; y < size.height; y++) {
+		float *row = band.ptr<float>(y);
+		for (int x = 0; x < size.width; x++) {
+			row[x] = (float)(x % 100);
+		}
+	}
+	band.at<float>(0, 0) = std::numeric_limits<float>::infinity();
+	band.at<float>(1, 1) = -std::numeric_limits<float>::infinity();
+	band.at<float>(2, 2) = std::numeric_limits<float>::quiet_NaN();
+	// on the decimated grid of the approximate pass as well
+	band.at<float>(size.height - 1, size.width - 3) = std::numeric_limits<float>::infinity();
+	band.at<float>(size.height - 1, size.width - 1) = -std::numeric_limits<float>::infinity();
+
+	const QString fileName = workDir + "/stats_check.tif";
+	if (!write_raster(fileName, band, geo, wkt)) {
+		err << "Cannot write the statistics raster to " << workDir << "." << endl;
+		return false;
+	}
+	GDALDataset *dataset = (GDALDataset *)GDALOpen(fileName.toLocal8Bit().constData(), GA_ReadOnly);
+	if (dataset == NULL) {
+		err << "Cannot read the statistics raster back." << endl;
+		return false;
+	}
+
+	bool ok = true;
+	const char *passNames[] = { "exact", "approximate" };
+	for (int i = 0; i < 2; i++) {
+		QList<BandStatistics> stats;
+		const bool computed = i == 0 ? StatisticsCache::compute(dataset, stats) : StatisticsCache::approximate(dataset, stats);
+		const bool finite = computed && stats.size() == 1 && std::isfinite(stats[0].min) && std::isfinite(stats[0].max) &&
+			std::isfinite(stats[0].mean) && std::isfinite(stats[0].stdDev);
+		out << "statistics check\t" << passNames[i] << "\t" << (finite ? "ok" : "failed") << endl;
+		if (!finite || (i == 0 && (stats[0].min != 0 || stats[0].max != 99))) {
+			err << "The " << passNames[i] << " statistics do not skip non-finite samples." << endl;
+			ok = false;
+		}
+	}
+	GDALClose((GDALDatasetH)dataset);
+	VSIUnlink(fileName.toLocal8Bit().constData());
+	return ok;
+}
+
+static QList<int> parse_ints(const QString& list)
+{
+	QList<int> values;
+	const QStringList items = list.split(',', QString::SkipEmptyParts);
+	for (int i = 0; i < items.size(); i++) {
+		const int value = items[i].trimmed().toInt();
+		if (value > 0) { values << value; }
+	}
+	return values;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qssa-bench");
+
+	QString defaultThreads;
+	for (int n = 1; n < QThread::idealThreadCount(); n *= 2) {
+		defaultThreads += QString::number(n) + ",";
+	}
+	defaultThreads += QString::number(QThread::idealThreadCount());
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Benchmark the submerging stages on synthetic DEM and Landsat scenes.");
+	parser.addHelpOption();
+	QCommandLineOption sizesOption("sizes", "Comma separated Landsat sizes in pixels, 1024 to 32768 (default 1024,2048,4096).", "list", "1024,2048,4096");
+	QCommandLineOption terrainOption("terrain", "Comma separated terrains: ramp, fractal, shelf (default all).", "list", "ramp,fractal,shelf");
+	QCommandLineOption threadsOption("threads", "Comma separated thread counts (default powers of two up to all cores).", "list", defaultThreads);
+	QCommandLineOption methodOption("method", "Comma separated methods: passive, active (default both).", "list", "passive,active");
+	QCommandLineOption workOption("workdir", "Folder for the synthetic rasters (default in memory).", "dir", "/vsimem/qssa_bench");
+	QCommandLineOption jsonOption("json", "Machine readable results (default qssa_bench.json).", "file", "qssa_bench.json");
+	QCommandLineOption seedOption("seed", "Random seed of the synthetic scenes.", "n", "12345");
+	QCommandLineOption checkOption("check", "Check the DEM sampling on a linear ramp and the band statistics of non-finite samples, then exit.");
+	QCommandLineOption conversionOption("no-conversion", "Skip the row conversion micro-benchmark.");
+	parser.addOption(sizesOption);
+	parser.addOption(terrainOption);
+	parser.addOption(threadsOption);
+	parser.addOption(methodOption);
+	parser.addOption(workOption);
+	parser.addOption(jsonOption);
+	parser.addOption(seedOption);
+	parser.addOption(checkOption);
+	parser.addOption(conversionOption);
+	parser.process(app);
+
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	const QList<int> sizes = parse_ints(parser.value(sizesOption));
+	const QList<int> threadCounts = parse_ints(parser.value(threadsOption));
+	const QStringList terrains = parser.value(terrainOption).split(',', QString::SkipEmptyParts);
+	const QStringList methods = parser.value(methodOption).split(',', QString::SkipEmptyParts);
+	const QString workDir = parser.value(workOption);
+	if (!workDir.startsWith("/vsimem")) {
+		QDir().mkpath(workDir);
+	}
+	QTemporaryDir outputDir;
+	if (!outputDir.isValid()) {
+		err << "Cannot create a temporary output folder." << endl;
+		return 1;
+	}
+
+	GDALAllRegister();
+	OGRSpatialReference wgs84;
+	wgs84.SetWellKnownGeogCS("WGS84");
+	char *wktBuffer = NULL;
+	wgs84.exportToWkt(&wktBuffer);
+	const std::string wkt = wktBuffer;
+	CPLFree(wktBuffer);
+
+	if (parser.isSet(checkOption)) {
+		const bool sampling = check_ramp_sampling(workDir, wkt, out, err);
+		const bool statistics = check_statistics(workDir, wkt, out, err);
+		return sampling && statistics ? 0 : 1;
+	}
+
+	const int idealThreads = QThread::idealThreadCount();
+	QJsonArray conversion;
+	if (!parser.isSet(conversionOption)) {
+		out << "stage\ttype\tchannels\tms\tMpixel/s\twrite_pixel ms\twrite_pixel Mpixel/s\tspeedup" << endl;
+		conversion = bench_conversion(out);
+	}
+
+	QJsonArray results;
+	out << "terrain\tsize\tmethod\tthreads\tstage\tms\tMpixel/s" << endl;
+
+	for (int s = 0; s < sizes.size(); s++) {
+		for (int t = 0; t < terrains.size(); t++) {
+			const int terrainIndex = QStringList({ "ramp", "fractal", "shelf" }).indexOf(terrains[t].trimmed().toLower());
+			if (terrainIndex < 0) {
+				err << "Unknown terrain '" << terrains[t] << "'." << endl;
+				return 2;
+			}
+			const Terrain terrain = (Terrain)terrainIndex;
+			const QString name = QString("%1_%2").arg(TERRAIN_NAMES[terrain]).arg(sizes[s]);
+
+			// 15 m Landsat over a 30 m DEM, one degree square
+			const cv::Size landsatSize(sizes[s], sizes[s]);
+			const cv::Size demSize(std::max(1, sizes[s] / 2), std::max(1, sizes[s] / 2));
+			const double landsatGeo[6] = { 120, 1.0 / landsatSize.width, 0, 31, 0, -1.0 / landsatSize.height };
+			const double demGeo[6] = { 120, 1.0 / demSize.width, 0, 31, 0, -1.0 / demSize.height };
+
+			cv::RNG rng(parser.value(seedOption).toULongLong() + s * 3 + terrain);
+			const cv::Mat dem = make_dem(terrain, demSize, rng);
+			const QString demName = workDir + "/dem_" + name + ".tif";
+			const QString landsatName = workDir + "/landsat_" + name + ".tif";
+			if (!write_raster(demName, dem, demGeo, wkt) ||
+				!write_raster(landsatName, make_landsat(dem, landsatSize, rng), landsatGeo, wkt)) {
+				err << "Cannot write the synthetic rasters to " << workDir << "." << endl;
+				return 1;
+			}
+
+			// one untimed open leaves the statistics sidecar behind (files on
+			// disk), so every timed load below does the same work
+			delete open_layer(demName, idealThreads);
+			delete open_layer(landsatName, idealThreads);
+
+			const double mpixels = (double)landsatSize.area() / 1e6;
+			for (int n = 0; n < threadCounts.size(); n++) {
+				cv::setNumThreads(threadCounts[n]);
+
+				// the readers use as many threads as the stages
+				QElapsedTimer timer;
+				timer.start();
+				QScopedPointer<MapLayer> demLayer(open_layer(demName, threadCounts[n]));
+				QScopedPointer<MapLayer> landsatLayer(open_layer(landsatName, threadCounts[n]));
+				if (!demLayer || !landsatLayer) {
+					err << "Cannot read the synthetic rasters back." << endl;
+					return 1;
+				}
+				const qint64 loadMs = timer.elapsed();
+
+				for (int m = 0; m < methods.size(); m++) {
+					const bool active = methods[m].trimmed().toLower() == "active";
+
+					Submerge submerge;
+					submerge.m_dem = demLayer.data();
+					submerge.m_landsat = landsatLayer.data();
+					submerge.m_submergeMethod = active ? Submerge::ACTIVE_SUBMERGING : Submerge::PASSIVE_SUBMERGING;
+					submerge.m_outputDir = outputDir.path();
+
+					QList<QPair<QString, qint64> > stages;
+					stages << qMakePair(QString("load"), loadMs);
+
+					// registration: corners, transformation and maps
+					timer.start();
+					submerge.setCorners();
+					submerge.prepareTransform();
+					cv::Rect demRoi;
+					cv::Mat mapX;
+					cv::Mat mapY;
+					submerge.registerMaps(cv::Rect(cv::Point(0, 0), landsatSize), demRoi, mapX, mapY, submerge.m_outOfBounds);
+					stages << qMakePair(QString("registration"), timer.elapsed());
+
+					// sampling the DEM onto the grid
+					timer.start();
+					submerge.sampleDem(demRoi, mapX, mapY, submerge.m_outOfBounds, submerge.m_elevation);
+					submerge.buildColorRamp();
+					stages << qMakePair(QString("sampling"), timer.elapsed());
+
+					// flood classification at every colour level
+					timer.start();
+					submerge.m_floodLevel.release();
+					submerge.m_floodOnset.release();
+					if (active) {
+						submerge.floodConnected();
+					}
+					else {
+						cv::Mat mask;
+						for (size_t i = 0; i < submerge.color_submerge.size(); i++) {
+							submerge.floodMask(submerge.color_submerge[i].second, mask);
+						}
+					}
+					stages << qMakePair(QString("classification"), timer.elapsed());
+
+					// heat map and flood colouring
+					timer.start();
+					cv::Mat heatmap;
+					cv::Mat flood;
+					cv::Mat classes;
+					cv::Mat depth;
+					submerge.renderImages(heatmap, flood, classes, depth);
+					stages << qMakePair(QString("coloring"), timer.elapsed());
+
+					// output writing
+					timer.start();
+					submerge.writeImages(heatmap, flood, classes, depth);
+					stages << qMakePair(QString("writing"), timer.elapsed());
+
+					QJsonObject result;
+					result["terrain"] = QString(TERRAIN_NAMES[terrain]);
+					result["size"] = sizes[s];
+					result["method"] = QString(active ? "active" : "passive");
+					result["threads"] = threadCounts[n];
+					QJsonObject stageResults;
+					qint64 totalMs = 0;
+					for (int i = 0; i < stages.size(); i++) {
+						const qint64 ms = stages[i].second;
+						const double rate = mpixels / std::max<qint64>(ms, 1) * 1000;
+						QJsonObject stage;
+						stage["ms"] = ms;
+						stage["mpixel_per_s"] = rate;
+						stageResults[stages[i].first] = stage;
+						if (i > 0) { totalMs += ms; }
+						out << TERRAIN_NAMES[terrain] << "\t" << sizes[s] << "\t" << result["method"].toString() << "\t"
+							<< threadCounts[n] << "\t" << stages[i].first << "\t" << ms << "\t" << rate << endl;
+					}
+					result["stages"] = stageResults;
+					result["run_ms"] = totalMs;
+					result["run_mpixel_per_s"] = mpixels / std::max<qint64>(totalMs, 1) * 1000;
+					results.append(result);
+				}
+			}
+
+			StatisticsCache::remove(demName);
+			StatisticsCache::remove(landsatName);
+			VSIUnlink(demName.toLocal8Bit().constData());
+			VSIUnlink(landsatName.toLocal8Bit().constData());
+		}
+	}
+
+	QJsonObject report;
+	report["ideal_threads"] = idealThreads;
+	report["conversion"] = conversion;
+	report["results"] = results;
+	QFile jsonFile(parser.value(jsonOption));
+	if (!jsonFile.open(QIODevice::WriteOnly)) {
+		err << "Cannot write " << jsonFile.fileName() << "." << endl;
+		return 1;
+	}
+	jsonFile.write(QJsonDocument(report).toJson());
+	return 0;
+}
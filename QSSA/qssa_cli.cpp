@@ -0,0 +1,242 @@
+/*
+* qssa_cli.cpp -- Run the submerging analysis without the GUI, for batches of sea levels
+*/
+
+// Qt Headers
+#include <QtCore>
+
+// C++ Standard Libraries
+#include <cmath>
+
+// User Headers
+#include "MapLayer.h"
+#include "Submerge.h"
+
+/*
+* Open a layer and read it, lazily if asked to. Exact band statistics run
+* in the background after an approximate pass; wait for them so they do
+* not compete with the timed stages.
+*/
+static MapLayer *open_layer(const QString& fileName, const bool& lazy, const int& threads)
+{
+	MapLayer *layer = new MapLayer(fileName);
+	layer->setLazy(lazy);
+	layer->m_ioThreads = threads;
+	if (!layer->readHeader()) {
+		delete layer;
+		return nullptr;
+	}
+	layer->initMatData();
+	if (!layer->readData()) {
+		delete layer;
+		return nullptr;
+	}
+	layer->waitForStatistics();
+	return layer;
+}
+
+/*
+* Write a flood mask as a single band, tiled GeoTIFF on the landsat grid,
+* with the same layout and compression as the other outputs
+*/
+static bool write_mask(const QString& fileName, MapLayer *reference, const cv::Mat& mask)
+{
+	GeoTiffWriter writer;
+	if (!writer.open(fileName, mask.size(), 1, GDT_Byte, reference->m_adfGeoTransform,
+			reference->m_dataset->GetProjectionRef(), Submerge::TILED_BLOCK_SIZE)) {
+		return false;
+	}
+	// close() waits for the encoder, so the mask can be reused afterwards
+	writer.write(cv::Rect(cv::Point(0, 0), mask.size()), mask);
+	return writer.close();
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qssa-cli");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Submerging analysis of a DEM over a Landsat scene.");
+	parser.addHelpOption();
+
+	QCommandLineOption demOption("dem", "DEM raster.", "file");
+	QCommandLineOption landsatOption("landsat", "Landsat scene.", "file");
+	QCommandLineOption waterOption("water-mask", "Water raster seeding active submerging, nonzero is water (default: the DEM edges).", "file");
+	QCommandLineOption methodOption("method", "passive or active submerging (default passive).", "method", "passive");
+	QCommandLineOption matchOption("match", "crs, sift or orb registration (default crs).", "method", "crs");
+	QCommandLineOption levelsOption("levels", "Comma separated sea levels to write flood masks for.", "list");
+	QCommandLineOption outputOption("output", "Output folder (default Data/Output).", "dir", "Data/Output");
+	QCommandLineOption resamplingOption("resampling", "nearest, bilinear or bicubic DEM sampling (default nearest).", "mode", "nearest");
+	QCommandLineOption connectivityOption("connectivity", "4 or 8 connected active flooding (default 8).", "n", "8");
+	QCommandLineOption toleranceOption("tolerance", "Cross CRS registration tolerance in DEM pixels (default 0.125).", "pixels", "0.125");
+	QCommandLineOption threadsOption("threads", "Reader threads per layer (default: all cores).", "n",
+		QString::number(QThread::idealThreadCount()));
+	QCommandLineOption lazyOption("lazy", "Read layers on demand through the tile cache.");
+	QCommandLineOption streamingOption("streaming", "Stream passive submerging tile by tile into tiled GeoTIFFs.");
+	QCommandLineOption traceOption("trace", "Write the stage timings as Chrome trace-event JSON.", "file");
+	parser.addOption(demOption);
+	parser.addOption(landsatOption);
+	parser.addOption(waterOption);
+	parser.addOption(methodOption);
+	parser.addOption(matchOption);
+	parser.addOption(levelsOption);
+	parser.addOption(outputOption);
+	parser.addOption(resamplingOption);
+	parser.addOption(connectivityOption);
+	parser.addOption(toleranceOption);
+	parser.addOption(threadsOption);
+	parser.addOption(lazyOption);
+	parser.addOption(streamingOption);
+	parser.addOption(traceOption);
+	parser.process(app);
+
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+	if (!parser.isSet(demOption) || !parser.isSet(landsatOption)) {
+		err << "Both --dem and --landsat are required." << endl;
+		return 2;
+	}
+
+	// sea levels
+	QList<double> levels;
+	const QStringList levelList = parser.value(levelsOption).split(',', QString::SkipEmptyParts);
+	for (int i = 0; i < levelList.size(); i++) {
+		bool ok;
+		const double level = levelList[i].trimmed().toDouble(&ok);
+		if (!ok) {
+			err << "Invalid sea level '" << levelList[i] << "'." << endl;
+			return 2;
+		}
+		levels << level;
+	}
+	if (!levels.isEmpty() && parser.isSet(streamingOption)) {
+		err << "--levels needs the in-memory grid and cannot be combined with --streaming." << endl;
+		return 2;
+	}
+
+	Submerge submerge;
+	const QString method = parser.value(methodOption).toLower();
+	if (method == "passive") { submerge.m_submergeMethod = Submerge::PASSIVE_SUBMERGING; }
+	else if (method == "active") { submerge.m_submergeMethod = Submerge::ACTIVE_SUBMERGING; }
+	else {
+		err << "Unknown method '" << method << "'." << endl;
+		return 2;
+	}
+	if (parser.isSet(waterOption) && submerge.m_submergeMethod != Submerge::ACTIVE_SUBMERGING) {
+		err << "--water-mask only seeds active submerging." << endl;
+		return 2;
+	}
+
+	const QString match = parser.value(matchOption).toLower();
+	if (match == "crs") { submerge.m_matchMethod = Submerge::BASE_GEOGCS; }
+	else if (match == "sift") { submerge.m_matchMethod = Submerge::BASE_SIFT; }
+	else if (match == "orb") { submerge.m_matchMethod = Submerge::BASE_ORB; }
+	else {
+		err << "Unknown match method '" << match << "'." << endl;
+		return 2;
+	}
+
+	const QString resampling = parser.value(resamplingOption).toLower();
+	if (resampling == "nearest") { submerge.m_resampling = Submerge::NEAREST_SAMPLING; }
+	else if (resampling == "bilinear") { submerge.m_resampling = Submerge::BILINEAR_SAMPLING; }
+	else if (resampling == "bicubic") { submerge.m_resampling = Submerge::BICUBIC_SAMPLING; }
+	else {
+		err << "Unknown resampling '" << resampling << "'." << endl;
+		return 2;
+	}
+
+	const QString connectivity = parser.value(connectivityOption);
+	if (connectivity == "4") { submerge.m_connectivity = FloodFill::FOUR_CONNECTED; }
+	else if (connectivity == "8") { submerge.m_connectivity = FloodFill::EIGHT_CONNECTED; }
+	else {
+		err << "Unknown connectivity '" << connectivity << "'." << endl;
+		return 2;
+	}
+
+	bool ok;
+	submerge.m_transformTolerance = parser.value(toleranceOption).toDouble(&ok);
+	if (!ok || !std::isfinite(submerge.m_transformTolerance) || submerge.m_transformTolerance < 0) {
+		err << "Invalid tolerance '" << parser.value(toleranceOption) << "'." << endl;
+		return 2;
+	}
+	submerge.m_streaming = parser.isSet(streamingOption);
+	submerge.m_outputDir = parser.value(outputOption);
+	QDir().mkpath(submerge.m_outputDir);
+
+	QJsonObject timing;
+	QElapsedTimer total;
+	QElapsedTimer timer;
+	total.start();
+
+	// read the inputs
+	GDALAllRegister();
+	timer.start();
+	const bool lazy = parser.isSet(lazyOption) || parser.isSet(streamingOption);
+	const int threads = std::max(1, parser.value(threadsOption).toInt());
+	QScopedPointer<MapLayer> dem(open_layer(parser.value(demOption), lazy, threads));
+	QScopedPointer<MapLayer> landsat(open_layer(parser.value(landsatOption), lazy, threads));
+	if (!dem || !landsat) {
+		err << "Cannot read " << (!dem ? parser.value(demOption) : parser.value(landsatOption)) << "." << endl;
+		return 1;
+	}
+	QScopedPointer<MapLayer> water;
+	if (parser.isSet(waterOption)) {
+		water.reset(open_layer(parser.value(waterOption), lazy, threads));
+		if (!water) {
+			err << "Cannot read " << parser.value(waterOption) << "." << endl;
+			return 1;
+		}
+	}
+	timing["load_ms"] = timer.elapsed();
+	out << "load\t" << timer.elapsed() << " ms" << endl;
+
+	// heat map and flood images
+	submerge.m_dem = dem.data();
+	submerge.m_landsat = landsat.data();
+	submerge.m_water = water.data();
+	timer.start();
+	if (!submerge.run()) {
+		err << submerge.m_lastError << endl;
+		return 1;
+	}
+	timing["submerge_ms"] = timer.elapsed();
+	out << "submerge\t" << timer.elapsed() << " ms" << endl;
+
+	// one flood mask per sea level
+	QJsonArray levelTiming;
+	const QString baseName = QFileInfo(landsat->m_filename).baseName();
+	for (int i = 0; i < levels.size(); i++) {
+		timer.start();
+		cv::Mat mask;
+		if (!submerge.floodMask(levels[i], mask)) {
+			err << "No flood grid to threshold." << endl;
+			return 1;
+		}
+		const QString maskName = submerge.m_outputDir + "/" + baseName + "_flood_" + QString::number(levels[i]) + "m.tif";
+		if (!write_mask(maskName, landsat.data(), mask)) {
+			err << "Cannot write " << maskName << "." << endl;
+			return 1;
+		}
+
+		QJsonObject entry;
+		entry["level"] = levels[i];
+		entry["flooded_cells"] = (double)cv::countNonZero(mask);
+		entry["ms"] = timer.elapsed();
+		levelTiming.append(entry);
+		out << "level " << levels[i] << "\t" << timer.elapsed() << " ms" << endl;
+	}
+	timing["levels"] = levelTiming;
+	timing["total_ms"] = total.elapsed();
+	out << "total\t" << total.elapsed() << " ms" << endl;
+
+	QFile timingFile(submerge.m_outputDir + "/" + baseName + "_timing.json");
+	if (timingFile.open(QIODevice::WriteOnly)) {
+		timingFile.write(QJsonDocument(timing).toJson());
+	}
+	if (parser.isSet(traceOption) && !Profiler::instance()->writeChromeTrace(parser.value(traceOption))) {
+		err << "Cannot write " << parser.value(traceOption) << "." << endl;
+		return 1;
+	}
+	return 0;
+}